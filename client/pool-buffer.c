@@ -1,5 +1,4 @@
-#define _POSIX_C_SOURCE 200809
-#include <assert.h>
+#define _GNU_SOURCE
 #include <cairo/cairo.h>
 #include <fcntl.h>
 #include <pango/pangocairo.h>
@@ -25,7 +24,7 @@ static bool set_cloexec(int fd) {
 	return true;
 }
 
-static int create_pool_file(size_t size, char **name) {
+static int create_tmp_file(void) {
 	static const char template[] = "sway-client-XXXXXX";
 	const char *path = getenv("XDG_RUNTIME_DIR");
 	if (path == NULL) {
@@ -34,14 +33,18 @@ static int create_pool_file(size_t size, char **name) {
 	}
 
 	size_t name_size = strlen(template) + 1 + strlen(path) + 1;
-	*name = malloc(name_size);
-	if (*name == NULL) {
+	char *name = malloc(name_size);
+	if (name == NULL) {
 		fprintf(stderr, "allocation failed\n");
 		return -1;
 	}
-	snprintf(*name, name_size, "%s/%s", path, template);
+	snprintf(name, name_size, "%s/%s", path, template);
 
-	int fd = mkstemp(*name);
+	int fd = mkstemp(name);
+	if (fd >= 0) {
+		unlink(name);
+	}
+	free(name);
 	if (fd < 0) {
 		return -1;
 	}
@@ -51,11 +54,30 @@ static int create_pool_file(size_t size, char **name) {
 		return -1;
 	}
 
+	return fd;
+}
+
+static int create_pool_file(size_t size) {
+	int fd = -1;
+#if HAVE_MEMFD_CREATE
+	fd = memfd_create("sway-client", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#endif
+	if (fd < 0) {
+		fd = create_tmp_file();
+		if (fd < 0) {
+			return -1;
+		}
+	}
+
 	if (ftruncate(fd, size) < 0) {
 		close(fd);
 		return -1;
 	}
 
+#ifdef F_SEAL_SHRINK
+	// The pool only ever grows, which lets the compositor trust the size
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK);
+#endif
 	return fd;
 }
 
@@ -68,69 +90,200 @@ static const struct wl_buffer_listener buffer_listener = {
 	.release = buffer_release
 };
 
+static bool create_pool(struct wl_shm *shm, struct buffer_pool *pool,
+		size_t size) {
+	int fd = create_pool_file(size);
+	if (fd < 0) {
+		fprintf(stderr, "failed to create shm pool file\n");
+		return false;
+	}
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+
+	pool->shm_pool = wl_shm_create_pool(shm, fd, size);
+	pool->fd = fd;
+	pool->data = data;
+	pool->size = size;
+	pool->used = 0;
+	return true;
+}
+
+static void map_buffer(struct buffer_pool *pool, struct pool_buffer *buffer) {
+	buffer->data = (char *)pool->data + buffer->offset;
+	buffer->surface = cairo_image_surface_create_for_data(buffer->data,
+			CAIRO_FORMAT_ARGB32, buffer->width, buffer->height,
+			buffer->width * 4);
+	buffer->cairo = cairo_create(buffer->surface);
+	buffer->pango = pango_cairo_create_context(buffer->cairo);
+}
+
+static void unmap_buffer(struct pool_buffer *buffer) {
+	if (buffer->pango) {
+		g_object_unref(buffer->pango);
+	}
+	if (buffer->cairo) {
+		cairo_destroy(buffer->cairo);
+	}
+	if (buffer->surface) {
+		cairo_surface_destroy(buffer->surface);
+	}
+	buffer->pango = NULL;
+	buffer->cairo = NULL;
+	buffer->surface = NULL;
+	buffer->data = NULL;
+}
+
+/**
+ * Destroys the buffer but leaves its region of the pool to it.
+ */
+static void destroy_buffer(struct pool_buffer *buffer) {
+	unmap_buffer(buffer);
+	if (buffer->buffer) {
+		wl_buffer_destroy(buffer->buffer);
+	}
+	buffer->buffer = NULL;
+	buffer->width = buffer->height = 0;
+	buffer->size = 0;
+	buffer->busy = false;
+}
+
+static bool resize_pool(struct buffer_pool *pool, size_t size) {
+	if (ftruncate(pool->fd, size) < 0) {
+		return false;
+	}
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			pool->fd, 0);
+	if (data == MAP_FAILED) {
+		return false;
+	}
+	wl_shm_pool_resize(pool->shm_pool, size);
+
+	// The buffers keep their offsets, so only their surfaces need to move
+	for (size_t i = 0; i < pool->length; ++i) {
+		unmap_buffer(&pool->buffers[i]);
+	}
+	munmap(pool->data, pool->size);
+	pool->data = data;
+	pool->size = size;
+	for (size_t i = 0; i < pool->length; ++i) {
+		if (pool->buffers[i].buffer) {
+			map_buffer(pool, &pool->buffers[i]);
+		}
+	}
+	return true;
+}
+
+static bool allocate_region(struct wl_shm *shm, struct buffer_pool *pool,
+		struct pool_buffer *buffer, size_t size) {
+	if (!pool->shm_pool) {
+		// Leave room for the other buffers at the same size
+		if (!create_pool(shm, pool, size * pool->length)) {
+			return false;
+		}
+	} else if (pool->used + size > pool->size) {
+		// Once none of the buffers are busy and none of them have the new
+		// size yet, their regions can be handed out again from the start
+		bool compact = true;
+		for (size_t i = 0; i < pool->length; ++i) {
+			struct pool_buffer *other = &pool->buffers[i];
+			if (other->busy || (other != buffer && other->buffer &&
+					other->size == size)) {
+				compact = false;
+				break;
+			}
+		}
+		if (compact) {
+			for (size_t i = 0; i < pool->length; ++i) {
+				destroy_buffer(&pool->buffers[i]);
+				pool->buffers[i].offset = pool->buffers[i].capacity = 0;
+			}
+			pool->used = 0;
+		}
+
+		size_t new_size = pool->used + size;
+		if (pool->used == 0 && new_size < size * pool->length) {
+			new_size = size * pool->length;
+		}
+		if (new_size > pool->size && !resize_pool(pool, new_size)) {
+			return false;
+		}
+	}
+
+	buffer->offset = pool->used;
+	buffer->capacity = size;
+	pool->used += size;
+	return true;
+}
+
 static struct pool_buffer *create_buffer(struct wl_shm *shm,
-		struct pool_buffer *buf, int32_t width, int32_t height,
-		uint32_t format) {
+		struct buffer_pool *pool, struct pool_buffer *buf,
+		int32_t width, int32_t height, uint32_t format) {
 	uint32_t stride = width * 4;
-	size_t size = stride * height;
+	size_t size = (size_t)stride * height;
 
-	char *name;
-	int fd = create_pool_file(size, &name);
-	assert(fd != -1);
-	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
-	buf->buffer = wl_shm_pool_create_buffer(pool, 0,
-			width, height, stride, format);
-	wl_shm_pool_destroy(pool);
-	close(fd);
-	unlink(name);
-	free(name);
+	if (size > buf->capacity && !allocate_region(shm, pool, buf, size)) {
+		return NULL;
+	}
 
+	buf->buffer = wl_shm_pool_create_buffer(pool->shm_pool, buf->offset,
+			width, height, stride, format);
 	buf->size = size;
 	buf->width = width;
 	buf->height = height;
-	buf->data = data;
-	buf->surface = cairo_image_surface_create_for_data(data,
-			CAIRO_FORMAT_ARGB32, width, height, stride);
-	buf->cairo = cairo_create(buf->surface);
-	buf->pango = pango_cairo_create_context(buf->cairo);
+	map_buffer(pool, buf);
 
 	wl_buffer_add_listener(buf->buffer, &buffer_listener, buf);
 	return buf;
 }
 
-void destroy_buffer(struct pool_buffer *buffer) {
-	if (buffer->buffer) {
-		wl_buffer_destroy(buffer->buffer);
-	}
-	if (buffer->cairo) {
-		cairo_destroy(buffer->cairo);
-	}
-	if (buffer->surface) {
-		cairo_surface_destroy(buffer->surface);
+void init_buffer_pool(struct buffer_pool *pool, size_t length) {
+	memset(pool, 0, sizeof(struct buffer_pool));
+	pool->fd = -1;
+	if (length < 1) {
+		length = 1;
+	} else if (length > POOL_BUFFERS_MAX) {
+		length = POOL_BUFFERS_MAX;
 	}
-	if (buffer->pango) {
-		g_object_unref(buffer->pango);
+	pool->length = length;
+}
+
+void finish_buffer_pool(struct buffer_pool *pool) {
+	for (size_t i = 0; i < pool->length; ++i) {
+		destroy_buffer(&pool->buffers[i]);
 	}
-	if (buffer->data) {
-		munmap(buffer->data, buffer->size);
+	if (pool->shm_pool) {
+		wl_shm_pool_destroy(pool->shm_pool);
+		munmap(pool->data, pool->size);
+		close(pool->fd);
 	}
-	memset(buffer, 0, sizeof(struct pool_buffer));
+	init_buffer_pool(pool, pool->length);
 }
 
 struct pool_buffer *get_next_buffer(struct wl_shm *shm,
-		struct pool_buffer pool[static 2], uint32_t width, uint32_t height) {
+		struct buffer_pool *pool, uint32_t width, uint32_t height) {
 	struct pool_buffer *buffer = NULL;
 
-	for (size_t i = 0; i < 2; ++i) {
-		if (pool[i].busy) {
+	for (size_t i = 0; i < pool->length; ++i) {
+		struct pool_buffer *candidate = &pool->buffers[i];
+		if (candidate->busy) {
 			continue;
 		}
-		buffer = &pool[i];
+		// Prefer a buffer which doesn't have to be recreated
+		if (!buffer || (candidate->width == width &&
+					candidate->height == height)) {
+			buffer = candidate;
+		}
 	}
 
 	if (!buffer) {
-		return NULL;
+		// The compositor holds on to all of them, add another one
+		if (pool->length == POOL_BUFFERS_MAX) {
+			return NULL;
+		}
+		buffer = &pool->buffers[pool->length++];
 	}
 
 	if (buffer->width != width || buffer->height != height) {
@@ -138,7 +291,7 @@ struct pool_buffer *get_next_buffer(struct wl_shm *shm,
 	}
 
 	if (!buffer->buffer) {
-		if (!create_buffer(shm, buffer, width, height,
+		if (!create_buffer(shm, pool, buffer, width, height,
 					WL_SHM_FORMAT_ARGB8888)) {
 			return NULL;
 		}
@@ -0,0 +1,182 @@
+#define _POSIX_C_SOURCE 200809L
+#include "hash.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+struct hash_entry {
+	struct hash_entry *next;
+	uint32_t hash;
+	const void *key;
+	void *value;
+};
+
+static uint32_t hash_ptr(const void *key) {
+	// Fibonacci hashing, so that sequential integer keys spread out
+	uint64_t value = (uintptr_t)key;
+	return (uint32_t)((value * 11400714819323198485llu) >> 32);
+}
+
+static uint32_t hash_key(hash_t *hash, const void *key) {
+	return hash->hash ? hash->hash(key) : hash_ptr(key);
+}
+
+static bool hash_key_equal(hash_t *hash, const void *a, const void *b) {
+	return hash->equal ? hash->equal(a, b) : a == b;
+}
+
+hash_t *create_hash(uint32_t (*hash_fn)(const void *key),
+		bool (*equal)(const void *a, const void *b)) {
+	hash_t *hash = malloc(sizeof(hash_t));
+	if (!hash) {
+		return NULL;
+	}
+	hash->capacity = 16;
+	hash->length = 0;
+	hash->buckets = calloc(hash->capacity, sizeof(struct hash_entry *));
+	hash->hash = hash_fn;
+	hash->equal = equal;
+	return hash;
+}
+
+void hash_free(hash_t *hash) {
+	if (hash == NULL) {
+		return;
+	}
+	for (int i = 0; i < hash->capacity; ++i) {
+		struct hash_entry *entry = hash->buckets[i];
+		while (entry) {
+			struct hash_entry *next = entry->next;
+			free(entry);
+			entry = next;
+		}
+	}
+	free(hash->buckets);
+	free(hash);
+}
+
+static void hash_resize(hash_t *hash) {
+	if (hash->length < hash->capacity - hash->capacity / 4) {
+		return;
+	}
+	int capacity = hash->capacity * 2;
+	struct hash_entry **buckets =
+		calloc(capacity, sizeof(struct hash_entry *));
+	if (!buckets) {
+		return;
+	}
+	for (int i = 0; i < hash->capacity; ++i) {
+		struct hash_entry *entry = hash->buckets[i];
+		while (entry) {
+			struct hash_entry *next = entry->next;
+			struct hash_entry **bucket = &buckets[entry->hash & (capacity - 1)];
+			entry->next = *bucket;
+			*bucket = entry;
+			entry = next;
+		}
+	}
+	free(hash->buckets);
+	hash->buckets = buckets;
+	hash->capacity = capacity;
+}
+
+static struct hash_entry **hash_find(hash_t *hash, const void *key,
+		uint32_t key_hash) {
+	struct hash_entry **entry = &hash->buckets[key_hash & (hash->capacity - 1)];
+	while (*entry) {
+		if ((*entry)->hash == key_hash &&
+				hash_key_equal(hash, (*entry)->key, key)) {
+			break;
+		}
+		entry = &(*entry)->next;
+	}
+	return entry;
+}
+
+void *hash_get(hash_t *hash, const void *key) {
+	struct hash_entry *entry = *hash_find(hash, key, hash_key(hash, key));
+	return entry ? entry->value : NULL;
+}
+
+void hash_set(hash_t *hash, const void *key, void *value) {
+	uint32_t key_hash = hash_key(hash, key);
+	struct hash_entry **slot = hash_find(hash, key, key_hash);
+	if (*slot) {
+		(*slot)->key = key;
+		(*slot)->value = value;
+		return;
+	}
+	struct hash_entry *entry = malloc(sizeof(struct hash_entry));
+	if (!entry) {
+		return;
+	}
+	entry->next = NULL;
+	entry->hash = key_hash;
+	entry->key = key;
+	entry->value = value;
+	*slot = entry;
+	hash->length++;
+	hash_resize(hash);
+}
+
+void *hash_del(hash_t *hash, const void *key) {
+	struct hash_entry **slot = hash_find(hash, key, hash_key(hash, key));
+	struct hash_entry *entry = *slot;
+	if (!entry) {
+		return NULL;
+	}
+	void *value = entry->value;
+	*slot = entry->next;
+	free(entry);
+	hash->length--;
+	return value;
+}
+
+void hash_for_each(hash_t *hash,
+		void (*f)(const void *key, void *value, void *data), void *data) {
+	for (int i = 0; i < hash->capacity; ++i) {
+		struct hash_entry *entry = hash->buckets[i];
+		while (entry) {
+			// Allow f to remove the current entry
+			struct hash_entry *next = entry->next;
+			f(entry->key, entry->value, data);
+			entry = next;
+		}
+	}
+}
+
+#define FNV_PRIME 16777619u
+
+// FNV-1a
+uint32_t hash_bytes(uint32_t seed, const void *data, size_t len) {
+	const unsigned char *bytes = data;
+	for (size_t i = 0; i < len; ++i) {
+		seed = (seed ^ bytes[i]) * FNV_PRIME;
+	}
+	return seed;
+}
+
+uint32_t hash_str(const void *key) {
+	uint32_t hash = HASH_SEED;
+	for (const unsigned char *c = key; *c; ++c) {
+		hash = (hash ^ *c) * FNV_PRIME;
+	}
+	return hash;
+}
+
+bool hash_str_equal(const void *a, const void *b) {
+	return strcmp(a, b) == 0;
+}
+
+uint32_t hash_str_case(const void *key) {
+	uint32_t hash = HASH_SEED;
+	for (const unsigned char *c = key; *c; ++c) {
+		hash = (hash ^ (unsigned char)tolower(*c)) * FNV_PRIME;
+	}
+	return hash;
+}
+
+bool hash_str_case_equal(const void *a, const void *b) {
+	return strcasecmp(a, b) == 0;
+}
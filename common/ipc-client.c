@@ -1,4 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -7,12 +10,16 @@
 #include <sys/un.h>
 #include <unistd.h>
 #include "ipc-client.h"
+#include "list.h"
 #include "log.h"
+#include "loop.h"
 
 static const char ipc_magic[] = {'i', '3', '-', 'i', 'p', 'c'};
 
 #define IPC_HEADER_SIZE (sizeof(ipc_magic) + 8)
 
+#define IPC_READ_SIZE 4096
+
 char *get_socketpath(void) {
 	const char *swaysock = getenv("SWAYSOCK");
 	if (swaysock) {
@@ -128,20 +135,29 @@ void free_ipc_response(struct ipc_response *response) {
 	free(response);
 }
 
-char *ipc_single_command(int socketfd, uint32_t type, const char *payload, uint32_t *len) {
-	char data[IPC_HEADER_SIZE];
+static void write_ipc_header(char *data, uint32_t type, uint32_t len) {
 	uint32_t *data32 = (uint32_t *)(data + sizeof(ipc_magic));
 	memcpy(data, ipc_magic, sizeof(ipc_magic));
-	memcpy(&data32[0], len, sizeof(*len));
+	memcpy(&data32[0], &len, sizeof(len));
 	memcpy(&data32[1], &type, sizeof(type));
+}
+
+void ipc_send_request(int socketfd, uint32_t type, const char *payload,
+		uint32_t len) {
+	char data[IPC_HEADER_SIZE];
+	write_ipc_header(data, type, len);
 
 	if (write(socketfd, data, IPC_HEADER_SIZE) == -1) {
 		sway_abort("Unable to send IPC header");
 	}
 
-	if (write(socketfd, payload, *len) == -1) {
+	if (write(socketfd, payload, len) == -1) {
 		sway_abort("Unable to send IPC payload");
 	}
+}
+
+char *ipc_single_command(int socketfd, uint32_t type, const char *payload, uint32_t *len) {
+	ipc_send_request(socketfd, type, payload, *len);
 
 	struct ipc_response *resp = ipc_recv_response(socketfd);
 	char *response = resp->payload;
@@ -150,3 +166,266 @@ char *ipc_single_command(int socketfd, uint32_t type, const char *payload, uint3
 
 	return response;
 }
+
+struct ipc_request {
+	ipc_response_handler_t handle_reply;
+	void *data;
+};
+
+struct ipc_client {
+	int socketfd;
+	struct loop *loop;
+	short mask; // what the loop waits for
+	bool connected;
+
+	ipc_response_handler_t handle_event;
+	void *data;
+
+	list_t *requests; // struct ipc_request, in the order they were sent
+
+	char *in; // received, but not yet handled
+	size_t in_len, in_capacity;
+	char *out; // queued, but not yet written
+	size_t out_len, out_capacity;
+};
+
+static bool reserve(char **buffer, size_t *capacity, size_t size) {
+	if (size <= *capacity) {
+		return true;
+	}
+	size_t new_capacity = *capacity ? *capacity : IPC_READ_SIZE;
+	while (new_capacity < size) {
+		new_capacity *= 2;
+	}
+	char *new_buffer = realloc(*buffer, new_capacity);
+	if (!new_buffer) {
+		sway_log(SWAY_ERROR, "Unable to allocate memory for IPC buffer");
+		return false;
+	}
+	*buffer = new_buffer;
+	*capacity = new_capacity;
+	return true;
+}
+
+static void handle_client_fd(int fd, short mask, void *data);
+
+static void update_loop_mask(struct ipc_client *client) {
+	short mask = client->out_len ? POLLIN | POLLOUT : POLLIN;
+	if (!client->loop || !client->connected || mask == client->mask) {
+		return;
+	}
+	loop_remove_fd(client->loop, client->socketfd);
+	loop_add_fd(client->loop, client->socketfd, mask, handle_client_fd, client);
+	client->mask = mask;
+}
+
+static void disconnect(struct ipc_client *client) {
+	if (!client->connected) {
+		return;
+	}
+	client->connected = false;
+	if (client->loop) {
+		loop_remove_fd(client->loop, client->socketfd);
+	}
+	client->handle_event(NULL, client->data);
+}
+
+static void handle_message(struct ipc_client *client,
+		struct ipc_response *response) {
+	if (response->type & (1u << 31)) {
+		client->handle_event(response, client->data);
+		return;
+	}
+
+	if (client->requests->length == 0) {
+		sway_log(SWAY_ERROR, "Unexpected IPC reply of type %u", response->type);
+		return;
+	}
+	struct ipc_request *request = client->requests->items[0];
+	list_del(client->requests, 0);
+	if (request->handle_reply) {
+		request->handle_reply(response, request->data);
+	}
+	free(request);
+}
+
+/**
+ * Handles the complete messages in the read buffer. Returns false if the
+ * stream is corrupt.
+ */
+static bool handle_messages(struct ipc_client *client) {
+	bool ok = true;
+	size_t offset = 0;
+	while (client->in_len - offset >= IPC_HEADER_SIZE) {
+		char *header = client->in + offset;
+		if (memcmp(header, ipc_magic, sizeof(ipc_magic)) != 0) {
+			sway_log(SWAY_ERROR, "Invalid IPC message header");
+			ok = false;
+			break;
+		}
+
+		struct ipc_response response;
+		memcpy(&response.size, header + sizeof(ipc_magic), sizeof(uint32_t));
+		memcpy(&response.type, header + sizeof(ipc_magic) + sizeof(uint32_t),
+				sizeof(uint32_t));
+		if (client->in_len - offset - IPC_HEADER_SIZE < response.size) {
+			break;
+		}
+
+		// Terminate the payload in place. There is always at least one spare
+		// byte after the data received, see ipc_client_dispatch.
+		response.payload = header + IPC_HEADER_SIZE;
+		char *end = response.payload + response.size;
+		char next = *end;
+		*end = '\0';
+		handle_message(client, &response);
+		*end = next;
+
+		offset += IPC_HEADER_SIZE + response.size;
+	}
+
+	if (offset) {
+		client->in_len -= offset;
+		memmove(client->in, client->in + offset, client->in_len);
+	}
+	return ok;
+}
+
+static void handle_client_fd(int fd, short mask, void *data) {
+	struct ipc_client *client = data;
+	if (mask & POLLOUT) {
+		ipc_client_flush(client);
+	}
+	if (mask & (POLLIN | POLLHUP | POLLERR)) {
+		ipc_client_dispatch(client);
+	}
+}
+
+struct ipc_client *ipc_client_create(int socketfd, struct loop *loop,
+		ipc_response_handler_t handle_event, void *data) {
+	struct ipc_client *client = calloc(1, sizeof(struct ipc_client));
+	if (!client) {
+		sway_log(SWAY_ERROR, "Unable to allocate memory for IPC client");
+		return NULL;
+	}
+	int flags = fcntl(socketfd, F_GETFL);
+	if (flags == -1 || fcntl(socketfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to make the IPC socket non-blocking");
+		free(client);
+		return NULL;
+	}
+	client->socketfd = socketfd;
+	client->loop = loop;
+	client->connected = true;
+	client->handle_event = handle_event;
+	client->data = data;
+	client->requests = create_list();
+	if (loop) {
+		client->mask = POLLIN;
+		loop_add_fd(loop, socketfd, POLLIN, handle_client_fd, client);
+	}
+	return client;
+}
+
+void ipc_client_destroy(struct ipc_client *client) {
+	if (!client) {
+		return;
+	}
+	if (client->loop && client->connected) {
+		loop_remove_fd(client->loop, client->socketfd);
+	}
+	list_free_items_and_destroy(client->requests);
+	free(client->in);
+	free(client->out);
+	free(client);
+}
+
+void ipc_client_send(struct ipc_client *client, uint32_t type,
+		const char *payload, uint32_t len,
+		ipc_response_handler_t handle_reply, void *data) {
+	if (!client->connected) {
+		return;
+	}
+	struct ipc_request *request = malloc(sizeof(struct ipc_request));
+	if (!request || !reserve(&client->out, &client->out_capacity,
+				client->out_len + IPC_HEADER_SIZE + len)) {
+		sway_log(SWAY_ERROR, "Unable to queue IPC request");
+		free(request);
+		return;
+	}
+	request->handle_reply = handle_reply;
+	request->data = data;
+	list_add(client->requests, request);
+
+	write_ipc_header(client->out + client->out_len, type, len);
+	client->out_len += IPC_HEADER_SIZE;
+	if (len) {
+		memcpy(client->out + client->out_len, payload, len);
+		client->out_len += len;
+	}
+
+	ipc_client_flush(client);
+}
+
+bool ipc_client_dispatch(struct ipc_client *client) {
+	bool closed = false;
+	while (client->connected) {
+		// Keep a spare byte to terminate the last payload in place
+		if (!reserve(&client->in, &client->in_capacity,
+					client->in_len + IPC_READ_SIZE + 1)) {
+			closed = true;
+			break;
+		}
+		ssize_t received = recv(client->socketfd, client->in + client->in_len,
+				client->in_capacity - client->in_len - 1, 0);
+		if (received == 0) {
+			sway_log(SWAY_ERROR, "IPC connection closed");
+			closed = true;
+			break;
+		} else if (received < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				sway_log_errno(SWAY_ERROR, "Unable to receive IPC response");
+				closed = true;
+			}
+			break;
+		}
+		client->in_len += received;
+	}
+
+	if (client->connected && !handle_messages(client)) {
+		closed = true;
+	}
+	if (closed) {
+		disconnect(client);
+	}
+	return client->connected;
+}
+
+bool ipc_client_flush(struct ipc_client *client) {
+	size_t written = 0;
+	while (client->connected && written < client->out_len) {
+		ssize_t n = send(client->socketfd, client->out + written,
+				client->out_len - written, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				sway_log_errno(SWAY_ERROR, "Unable to send IPC request");
+				disconnect(client);
+			}
+			break;
+		}
+		written += n;
+	}
+
+	if (written) {
+		client->out_len -= written;
+		memmove(client->out, client->out + written, client->out_len);
+	}
+	update_loop_mask(client);
+	return client->connected;
+}
@@ -158,3 +158,53 @@ void list_free_items_and_destroy(list_t *list) {
 	list_free(list);
 }
 
+
+bool list_items_equal(list_t *a, list_t *b) {
+	if (a->length != b->length) {
+		return false;
+	}
+	return a->length == 0 ||
+		memcmp(a->items, b->items, sizeof(void *) * a->length) == 0;
+}
+
+struct list_snapshot {
+	list_t list;
+	int refs;
+	void *items[];
+};
+
+list_t *create_list_snapshot(list_t *source) {
+	int length = source ? source->length : 0;
+	// The items are allocated inline, so a snapshot costs a single allocation
+	struct list_snapshot *snapshot =
+		malloc(sizeof(struct list_snapshot) + sizeof(void *) * length);
+	if (!snapshot) {
+		return NULL;
+	}
+	snapshot->list.capacity = length;
+	snapshot->list.length = length;
+	snapshot->list.items = snapshot->items;
+	snapshot->refs = 1;
+	if (length) {
+		memcpy(snapshot->items, source->items, sizeof(void *) * length);
+	}
+	return &snapshot->list;
+}
+
+list_t *list_snapshot_ref(list_t *list) {
+	if (list) {
+		struct list_snapshot *snapshot = (struct list_snapshot *)list;
+		snapshot->refs++;
+	}
+	return list;
+}
+
+void list_snapshot_unref(list_t *list) {
+	if (!list) {
+		return;
+	}
+	struct list_snapshot *snapshot = (struct list_snapshot *)list;
+	if (--snapshot->refs == 0) {
+		free(snapshot);
+	}
+}
@@ -1,19 +1,29 @@
-#define _POSIX_C_SOURCE 199506L
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <strings.h>
 #include <time.h>
 #include <unistd.h>
+#include "list.h"
 #include "log.h"
 
+// Must be a power of two
+#define LOG_RING_SIZE 1024
+#define LOG_MESSAGE_SIZE 1000
+
 static terminate_callback_t log_terminate = exit;
 
 void _sway_abort(const char *format, ...) {
 	va_list args;
 	va_start(args, format);
-	_sway_vlog(SWAY_ERROR, format, args);
+	_sway_vlog(SWAY_ERROR, NULL, 0, format, args);
 	va_end(args);
+	sway_log_flush();
 	log_terminate(EXIT_FAILURE);
 }
 
@@ -24,10 +34,11 @@ bool _sway_assert(bool condition, const char *format, ...) {
 
 	va_list args;
 	va_start(args, format);
-	_sway_vlog(SWAY_ERROR, format, args);
+	_sway_vlog(SWAY_ERROR, NULL, 0, format, args);
 	va_end(args);
 
 #ifndef NDEBUG
+	sway_log_flush();
 	raise(SIGABRT);
 #endif
 
@@ -36,6 +47,16 @@ bool _sway_assert(bool condition, const char *format, ...) {
 
 static bool colored = true;
 static sway_log_importance_t log_importance = SWAY_ERROR;
+// The most verbose level enabled by either log_importance or a filter
+static sway_log_importance_t max_importance = SWAY_ERROR;
+
+struct log_filter {
+	char *prefix;
+	size_t prefix_len;
+	sway_log_importance_t importance;
+};
+
+static list_t *log_filters = NULL; // struct log_filter *
 
 static const char *verbosity_colors[] = {
 	[SWAY_SILENT] = "",
@@ -44,36 +65,439 @@ static const char *verbosity_colors[] = {
 	[SWAY_DEBUG ] = "\x1B[1;30m",
 };
 
-static void sway_log_stderr(sway_log_importance_t verbosity, const char *fmt,
-		va_list args) {
-	if (verbosity > log_importance) {
-		return;
-	}
-	// prefix the time to the log message
-	struct tm result;
-	time_t t = time(NULL);
-	struct tm *tm_info = localtime_r(&t, &result);
+/**
+ * A log message as stored in the ring buffer. The message is formatted by the
+ * caller, since the format arguments may not outlive the call, but the time
+ * prefix, source location and colors are formatted by the writer thread.
+ */
+struct log_record {
+	atomic_size_t sequence;
+	struct timespec time;
+	sway_log_importance_t verbosity;
+	const char *file;
+	int line;
+	char message[LOG_MESSAGE_SIZE];
+	char *long_message; // allocated if the message doesn't fit
+};
+
+static struct {
+	bool enabled;
+	struct log_record *records;
+	atomic_size_t enqueue_pos;
+	atomic_size_t written_pos;
+	size_t dequeue_pos; // only touched by the writer thread
+	atomic_bool running;
+	atomic_bool sleeping;
+	// Set by the crash handler, which then takes over writing the ring
+	atomic_bool crashing;
+	atomic_bool popping; // the writer thread is writing a record
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} async = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void log_vwrite(sway_log_importance_t verbosity, const struct tm *tm,
+		const char *file, int line, const char *fmt, va_list args) {
 	char buffer[26];
 
 	// generate time prefix
-	strftime(buffer, sizeof(buffer), "%F %T - ", tm_info);
+	strftime(buffer, sizeof(buffer), "%F %T - ", tm);
 	fprintf(stderr, "%s", buffer);
 
 	unsigned c = (verbosity < SWAY_LOG_IMPORTANCE_LAST) ? verbosity :
 		SWAY_LOG_IMPORTANCE_LAST - 1;
 
-	if (colored && isatty(STDERR_FILENO)) {
+	if (colored) {
 		fprintf(stderr, "%s", verbosity_colors[c]);
 	}
 
+	if (file) {
+		fprintf(stderr, "[%s:%d] ", _sway_strip_path(file), line);
+	}
 	vfprintf(stderr, fmt, args);
 
-	if (colored && isatty(STDERR_FILENO)) {
+	if (colored) {
 		fprintf(stderr, "\x1B[0m");
 	}
 	fprintf(stderr, "\n");
 }
 
+static void log_write(sway_log_importance_t verbosity, const struct tm *tm,
+		const char *file, int line, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	log_vwrite(verbosity, tm, file, line, fmt, args);
+	va_end(args);
+}
+
+static void sway_log_stderr(sway_log_importance_t verbosity, const char *file,
+		int line, const char *fmt, va_list args) {
+	// prefix the time to the log message
+	struct tm result;
+	time_t t = time(NULL);
+	struct tm *tm_info = localtime_r(&t, &result);
+	log_vwrite(verbosity, tm_info, file, line, fmt, args);
+}
+
+static bool log_ring_pop(struct tm *tm, time_t *tm_sec) {
+	struct log_record *record =
+		&async.records[async.dequeue_pos & (LOG_RING_SIZE - 1)];
+	size_t sequence = atomic_load(&record->sequence);
+	if (sequence != async.dequeue_pos + 1) {
+		return false;
+	}
+
+	// localtime_r is comparatively expensive, only redo it once per second
+	if (record->time.tv_sec != *tm_sec) {
+		*tm_sec = record->time.tv_sec;
+		localtime_r(tm_sec, tm);
+	}
+	log_write(record->verbosity, tm, record->file, record->line, "%s",
+		record->long_message ? record->long_message : record->message);
+	free(record->long_message);
+	record->long_message = NULL;
+
+	atomic_store(&record->sequence, async.dequeue_pos + LOG_RING_SIZE);
+	async.dequeue_pos++;
+	atomic_store(&async.written_pos, async.dequeue_pos);
+	return true;
+}
+
+static bool log_ring_empty(void) {
+	struct log_record *record =
+		&async.records[async.dequeue_pos & (LOG_RING_SIZE - 1)];
+	return atomic_load(&record->sequence) != async.dequeue_pos + 1;
+}
+
+static void *log_thread_run(void *data) {
+	struct tm tm = {0};
+	time_t tm_sec = -1;
+
+	while (true) {
+		while (true) {
+			atomic_store(&async.popping, true);
+			bool popped = !atomic_load(&async.crashing) &&
+				log_ring_pop(&tm, &tm_sec);
+			atomic_store(&async.popping, false);
+			if (!popped) {
+				break;
+			}
+		}
+		fflush(stderr);
+		if (atomic_load(&async.crashing)) {
+			return NULL;
+		}
+
+		pthread_mutex_lock(&async.mutex);
+		atomic_store(&async.sleeping, true);
+		// Wake up anyone waiting in sway_log_flush
+		pthread_cond_broadcast(&async.cond);
+		while (log_ring_empty() && atomic_load(&async.running)) {
+			pthread_cond_wait(&async.cond, &async.mutex);
+		}
+		atomic_store(&async.sleeping, false);
+		bool running = atomic_load(&async.running);
+		pthread_mutex_unlock(&async.mutex);
+
+		if (!running && log_ring_empty()) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void log_thread_wake(void) {
+	if (atomic_load(&async.sleeping)) {
+		pthread_mutex_lock(&async.mutex);
+		pthread_cond_broadcast(&async.cond);
+		pthread_mutex_unlock(&async.mutex);
+	}
+}
+
+static void sway_log_ring(sway_log_importance_t verbosity, const char *file,
+		int line, const char *fmt, va_list args) {
+	struct log_record *record;
+	size_t pos = atomic_load_explicit(&async.enqueue_pos,
+			memory_order_relaxed);
+	while (true) {
+		record = &async.records[pos & (LOG_RING_SIZE - 1)];
+		size_t sequence = atomic_load_explicit(&record->sequence,
+				memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&async.enqueue_pos,
+						&pos, pos + 1, memory_order_relaxed,
+						memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// The writer has fallen a full ring behind. Rather than dropping
+			// the message, wait for it to catch up and queue it after all.
+			// Writing it directly could put it before older messages.
+			sway_log_flush();
+			pos = atomic_load_explicit(&async.enqueue_pos,
+					memory_order_relaxed);
+		} else {
+			pos = atomic_load_explicit(&async.enqueue_pos,
+					memory_order_relaxed);
+		}
+	}
+
+	clock_gettime(CLOCK_REALTIME, &record->time);
+	record->verbosity = verbosity;
+	record->file = file;
+	record->line = line;
+	va_list args_copy;
+	va_copy(args_copy, args);
+	int len = vsnprintf(record->message, sizeof(record->message), fmt, args);
+	record->long_message = NULL;
+	if (len >= (int)sizeof(record->message)) {
+		record->long_message = malloc(len + 1);
+		if (record->long_message) {
+			vsnprintf(record->long_message, len + 1, fmt, args_copy);
+		}
+	}
+	va_end(args_copy);
+	atomic_store(&record->sequence, pos + 1);
+
+	log_thread_wake();
+}
+
+static const int crash_signals[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+
+// Only async-signal-safe functions from here on, the crash may have happened
+// anywhere, including inside malloc or stdio with their locks held
+
+static void crash_write(const char *str) {
+	size_t len = strlen(str);
+	while (len > 0) {
+		ssize_t n = write(STDERR_FILENO, str, len);
+		if (n <= 0) {
+			return;
+		}
+		str += n;
+		len -= n;
+	}
+}
+
+static void crash_write_uint(unsigned long value, int width) {
+	char buffer[24];
+	char *p = buffer + sizeof(buffer) - 1;
+	*p = '\0';
+	do {
+		*--p = '0' + value % 10;
+		value /= 10;
+	} while ((--width > 0 || value) && p > buffer);
+	crash_write(p);
+}
+
+/**
+ * Like log_ring_pop, without stdio or malloc. The time is written as seconds
+ * since the epoch, and long messages are left allocated.
+ */
+static bool log_ring_pop_crashing(void) {
+	struct log_record *record =
+		&async.records[async.dequeue_pos & (LOG_RING_SIZE - 1)];
+	size_t sequence = atomic_load(&record->sequence);
+	if (sequence != async.dequeue_pos + 1) {
+		return false;
+	}
+
+	crash_write_uint(record->time.tv_sec, 1);
+	crash_write(".");
+	crash_write_uint(record->time.tv_nsec / 1000000, 3);
+	crash_write(" - ");
+	unsigned c = (record->verbosity < SWAY_LOG_IMPORTANCE_LAST) ?
+		record->verbosity : SWAY_LOG_IMPORTANCE_LAST - 1;
+	if (colored) {
+		crash_write(verbosity_colors[c]);
+	}
+	if (record->file) {
+		crash_write("[");
+		crash_write(_sway_strip_path(record->file));
+		crash_write(":");
+		crash_write_uint(record->line, 1);
+		crash_write("] ");
+	}
+	crash_write(record->long_message ? record->long_message : record->message);
+	if (colored) {
+		crash_write("\x1B[0m");
+	}
+	crash_write("\n");
+
+	atomic_store(&record->sequence, async.dequeue_pos + LOG_RING_SIZE);
+	async.dequeue_pos++;
+	atomic_store(&async.written_pos, async.dequeue_pos);
+	return true;
+}
+
+/**
+ * Writes out whatever is still in the ring before the process dies, so the
+ * messages leading up to a crash aren't lost.
+ */
+static void log_crash_handler(int sig) {
+	atomic_store(&async.crashing, true);
+	// Give the writer thread a moment to finish the record it's writing. If
+	// it is the one crashing it never will, and the ring is left alone.
+	struct timespec delay = { .tv_nsec = 1000000 };
+	int tries = 100;
+	while (atomic_load(&async.popping) && tries-- > 0) {
+		nanosleep(&delay, NULL);
+	}
+	// A forked child has a copy of the ring, but the messages are the parent's
+	if (async.enabled && tries >= 0) {
+		while (log_ring_pop_crashing()) {
+			// Keep draining
+		}
+	}
+	// The handler was reset to the default action on entry
+	raise(sig);
+}
+
+static void install_crash_handlers(void) {
+	for (size_t i = 0; i < sizeof(crash_signals) / sizeof(crash_signals[0]); ++i) {
+		struct sigaction old;
+		if (sigaction(crash_signals[i], NULL, &old) == 0 &&
+				old.sa_handler != SIG_DFL) {
+			continue; // don't take over someone else's handler
+		}
+		struct sigaction action = { .sa_handler = log_crash_handler };
+		action.sa_flags = SA_RESETHAND | SA_NODEFER;
+		sigemptyset(&action.sa_mask);
+		sigaction(crash_signals[i], &action, NULL);
+	}
+}
+
+static void log_atfork_child(void) {
+	// The writer thread does not exist in the child
+	async.enabled = false;
+}
+
+static void log_stop_async(void) {
+	if (!async.enabled) {
+		return;
+	}
+	pthread_mutex_lock(&async.mutex);
+	atomic_store(&async.running, false);
+	pthread_cond_broadcast(&async.cond);
+	pthread_mutex_unlock(&async.mutex);
+	pthread_join(async.thread, NULL);
+	async.enabled = false;
+}
+
+bool sway_log_start_async(void) {
+	if (async.enabled) {
+		return true;
+	}
+	async.records = calloc(LOG_RING_SIZE, sizeof(struct log_record));
+	if (!async.records) {
+		return false;
+	}
+	for (size_t i = 0; i < LOG_RING_SIZE; ++i) {
+		atomic_init(&async.records[i].sequence, i);
+	}
+	atomic_store(&async.running, true);
+	// Signals are for the main thread, which may block some of them to read
+	// them from a signalfd. The writer thread must not receive them instead.
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	int ret = pthread_create(&async.thread, NULL, log_thread_run, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (ret != 0) {
+		free(async.records);
+		async.records = NULL;
+		return false;
+	}
+	async.enabled = true;
+
+	static bool registered = false;
+	if (!registered) {
+		registered = true;
+		atexit(log_stop_async);
+		pthread_atfork(NULL, NULL, log_atfork_child);
+		install_crash_handlers();
+	}
+	return true;
+}
+
+void sway_log_flush(void) {
+	if (!async.enabled) {
+		return;
+	}
+	size_t target = atomic_load(&async.enqueue_pos);
+	pthread_mutex_lock(&async.mutex);
+	while (atomic_load(&async.written_pos) < target) {
+		pthread_cond_broadcast(&async.cond);
+		pthread_cond_wait(&async.cond, &async.mutex);
+	}
+	pthread_mutex_unlock(&async.mutex);
+}
+
+static sway_log_importance_t parse_importance(const char *name) {
+	if (strcasecmp(name, "silent") == 0) {
+		return SWAY_SILENT;
+	} else if (strcasecmp(name, "error") == 0) {
+		return SWAY_ERROR;
+	} else if (strcasecmp(name, "info") == 0) {
+		return SWAY_INFO;
+	} else if (strcasecmp(name, "debug") == 0) {
+		return SWAY_DEBUG;
+	}
+	return SWAY_LOG_IMPORTANCE_LAST;
+}
+
+static void update_max_importance(void) {
+	max_importance = log_importance;
+	for (int i = 0; log_filters && i < log_filters->length; ++i) {
+		struct log_filter *filter = log_filters->items[i];
+		if (filter->importance > max_importance) {
+			max_importance = filter->importance;
+		}
+	}
+}
+
+void sway_log_set_filter(const char *spec) {
+	if (log_filters) {
+		for (int i = 0; i < log_filters->length; ++i) {
+			struct log_filter *filter = log_filters->items[i];
+			free(filter->prefix);
+			free(filter);
+		}
+		list_free(log_filters);
+		log_filters = NULL;
+	}
+
+	if (spec && *spec) {
+		log_filters = create_list();
+		char *copy = strdup(spec);
+		char *save = NULL;
+		for (char *item = strtok_r(copy, ",", &save); item;
+				item = strtok_r(NULL, ",", &save)) {
+			char *eq = strrchr(item, '=');
+			if (!eq) {
+				continue;
+			}
+			*eq = '\0';
+			sway_log_importance_t importance = parse_importance(eq + 1);
+			if (importance == SWAY_LOG_IMPORTANCE_LAST) {
+				continue;
+			}
+			struct log_filter *filter = calloc(1, sizeof(struct log_filter));
+			filter->prefix = strdup(item);
+			filter->prefix_len = strlen(item);
+			filter->importance = importance;
+			list_add(log_filters, filter);
+		}
+		free(copy);
+	}
+
+	update_max_importance();
+}
+
 void sway_log_init(sway_log_importance_t verbosity, terminate_callback_t callback) {
 	if (verbosity < SWAY_LOG_IMPORTANCE_LAST) {
 		log_importance = verbosity;
@@ -81,16 +505,47 @@ void sway_log_init(sway_log_importance_t verbosity, terminate_callback_t callbac
 	if (callback) {
 		log_terminate = callback;
 	}
+	colored = isatty(STDERR_FILENO);
+	sway_log_set_filter(getenv("SWAY_LOG_FILTER"));
 }
 
-void _sway_vlog(sway_log_importance_t verbosity, const char *fmt, va_list args) {
-	sway_log_stderr(verbosity, fmt, args);
+static bool log_enabled(sway_log_importance_t verbosity, const char *file) {
+	if (verbosity > max_importance) {
+		return false;
+	}
+	if (!file || !log_filters || !log_filters->length) {
+		return verbosity <= log_importance;
+	}
+	// The longest matching prefix wins
+	const char *path = _sway_strip_path(file);
+	struct log_filter *match = NULL;
+	for (int i = 0; i < log_filters->length; ++i) {
+		struct log_filter *filter = log_filters->items[i];
+		if (strncmp(path, filter->prefix, filter->prefix_len) == 0 &&
+				(!match || filter->prefix_len > match->prefix_len)) {
+			match = filter;
+		}
+	}
+	return verbosity <= (match ? match->importance : log_importance);
+}
+
+void _sway_vlog(sway_log_importance_t verbosity, const char *file, int line,
+		const char *fmt, va_list args) {
+	if (!log_enabled(verbosity, file)) {
+		return;
+	}
+	if (async.enabled) {
+		sway_log_ring(verbosity, file, line, fmt, args);
+	} else {
+		sway_log_stderr(verbosity, file, line, fmt, args);
+	}
 }
 
-void _sway_log(sway_log_importance_t verbosity, const char *fmt, ...) {
+void _sway_log(sway_log_importance_t verbosity, const char *file, int line,
+		const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
-	sway_log_stderr(verbosity, fmt, args);
+	_sway_vlog(verbosity, file, line, fmt, args);
 	va_end(args);
 }
 
@@ -2,16 +2,21 @@
 #include <limits.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <poll.h>
+#include <sys/epoll.h>
 #include <time.h>
 #include <unistd.h>
 #include "list.h"
 #include "log.h"
 #include "loop.h"
 
+#define LOOP_MAX_EVENTS 16
+
 struct loop_fd_event {
+	int fd; // -1 once removed from the loop
 	void (*callback)(int fd, short mask, void *data);
 	void *data;
 };
@@ -20,15 +25,19 @@ struct loop_timer {
 	void (*callback)(void *data);
 	void *data;
 	struct timespec expiry;
+	int index; // in the timer heap, -1 once taken out of it
 };
 
 struct loop {
-	struct pollfd *fds;
-	int fd_length;
+	int epoll_fd;
+
+	struct loop_fd_event **fd_events; // indexed by fd
 	int fd_capacity;
+	// Removed events which may still be referred to by the epoll results
+	// being dispatched
+	list_t *removed_fd_events; // struct loop_fd_event
 
-	list_t *fd_events; // struct loop_fd_event
-	list_t *timers; // struct loop_timer
+	list_t *timers; // struct loop_timer, binary min-heap ordered by expiry
 };
 
 struct loop *loop_create(void) {
@@ -37,92 +46,215 @@ struct loop *loop_create(void) {
 		sway_log(SWAY_ERROR, "Unable to allocate memory for loop");
 		return NULL;
 	}
-	loop->fd_capacity = 10;
-	loop->fds = malloc(sizeof(struct pollfd) * loop->fd_capacity);
-	loop->fd_events = create_list();
+	loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epoll_fd == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to create epoll instance");
+		free(loop);
+		return NULL;
+	}
+	loop->removed_fd_events = create_list();
 	loop->timers = create_list();
 	return loop;
 }
 
+static void free_removed_fd_events(struct loop *loop) {
+	for (int i = 0; i < loop->removed_fd_events->length; ++i) {
+		free(loop->removed_fd_events->items[i]);
+	}
+	loop->removed_fd_events->length = 0;
+}
+
 void loop_destroy(struct loop *loop) {
-	list_free_items_and_destroy(loop->fd_events);
+	for (int fd = 0; fd < loop->fd_capacity; ++fd) {
+		free(loop->fd_events[fd]);
+	}
+	free(loop->fd_events);
+	list_free_items_and_destroy(loop->removed_fd_events);
 	list_free_items_and_destroy(loop->timers);
-	free(loop->fds);
+	close(loop->epoll_fd);
 	free(loop);
 }
 
+static bool timer_before(struct loop_timer *a, struct loop_timer *b) {
+	return a->expiry.tv_sec < b->expiry.tv_sec ||
+		(a->expiry.tv_sec == b->expiry.tv_sec &&
+		 a->expiry.tv_nsec < b->expiry.tv_nsec);
+}
+
+static void timer_heap_swap(list_t *heap, int a, int b) {
+	list_swap(heap, a, b);
+	((struct loop_timer *)heap->items[a])->index = a;
+	((struct loop_timer *)heap->items[b])->index = b;
+}
+
+static void timer_heap_sift_up(list_t *heap, int index) {
+	while (index > 0) {
+		int parent = (index - 1) / 2;
+		if (!timer_before(heap->items[index], heap->items[parent])) {
+			break;
+		}
+		timer_heap_swap(heap, index, parent);
+		index = parent;
+	}
+}
+
+static void timer_heap_sift_down(list_t *heap, int index) {
+	while (true) {
+		int min = index;
+		int left = 2 * index + 1, right = 2 * index + 2;
+		if (left < heap->length &&
+				timer_before(heap->items[left], heap->items[min])) {
+			min = left;
+		}
+		if (right < heap->length &&
+				timer_before(heap->items[right], heap->items[min])) {
+			min = right;
+		}
+		if (min == index) {
+			break;
+		}
+		timer_heap_swap(heap, index, min);
+		index = min;
+	}
+}
+
+static void timer_heap_remove(list_t *heap, struct loop_timer *timer) {
+	int index = timer->index;
+	int last = heap->length - 1;
+	if (index != last) {
+		timer_heap_swap(heap, index, last);
+	}
+	list_del(heap, last);
+	timer->index = -1;
+	if (index < heap->length) {
+		timer_heap_sift_up(heap, index);
+		timer_heap_sift_down(heap, index);
+	}
+}
+
+static short epoll_to_poll(uint32_t events) {
+	short mask = 0;
+	if (events & EPOLLIN) {
+		mask |= POLLIN;
+	}
+	if (events & EPOLLPRI) {
+		mask |= POLLPRI;
+	}
+	if (events & EPOLLOUT) {
+		mask |= POLLOUT;
+	}
+	if (events & EPOLLERR) {
+		mask |= POLLERR;
+	}
+	if (events & EPOLLHUP) {
+		mask |= POLLHUP;
+	}
+	return mask;
+}
+
+static uint32_t poll_to_epoll(short mask) {
+	// EPOLLERR and EPOLLHUP are always reported
+	uint32_t events = 0;
+	if (mask & POLLIN) {
+		events |= EPOLLIN;
+	}
+	if (mask & POLLPRI) {
+		events |= EPOLLPRI;
+	}
+	if (mask & POLLOUT) {
+		events |= EPOLLOUT;
+	}
+	return events;
+}
+
 void loop_poll(struct loop *loop) {
-	// Calculate next timer in ms
-	int ms = INT_MAX;
+	// Calculate next timer in ms, rounding up so the timer has expired by
+	// the time the wait is over
+	int ms = -1;
 	if (loop->timers->length) {
+		struct loop_timer *timer = loop->timers->items[0];
 		struct timespec now;
 		clock_gettime(CLOCK_MONOTONIC, &now);
-		for (int i = 0; i < loop->timers->length; ++i) {
-			struct loop_timer *timer = loop->timers->items[i];
-			int timer_ms = (timer->expiry.tv_sec - now.tv_sec) * 1000;
-			timer_ms += (timer->expiry.tv_nsec - now.tv_nsec) / 1000000;
-			if (timer_ms < ms) {
-				ms = timer_ms;
-			}
+		int64_t timer_ns = (int64_t)(timer->expiry.tv_sec - now.tv_sec) *
+			1000000000 + (timer->expiry.tv_nsec - now.tv_nsec);
+		if (timer_ns <= 0) {
+			ms = 0;
+		} else if (timer_ns / 1000000 >= INT_MAX) {
+			ms = INT_MAX;
+		} else {
+			ms = (timer_ns + 999999) / 1000000;
 		}
 	}
-	if (ms < 0) {
-		ms = 0;
-	}
 
-	poll(loop->fds, loop->fd_length, ms);
+	struct epoll_event events[LOOP_MAX_EVENTS];
+	int n = epoll_wait(loop->epoll_fd, events, LOOP_MAX_EVENTS, ms);
 
 	// Dispatch fds
-	for (int i = 0; i < loop->fd_length; ++i) {
-		struct pollfd pfd = loop->fds[i];
-		struct loop_fd_event *event = loop->fd_events->items[i];
-
-		// Always send these events
-		unsigned events = pfd.events | POLLHUP | POLLERR;
-
-		if (pfd.revents & events) {
-			event->callback(pfd.fd, pfd.revents, event->data);
+	for (int i = 0; i < n; ++i) {
+		struct loop_fd_event *event = events[i].data.ptr;
+		// The fd may have been removed by an earlier callback
+		if (event->fd != -1) {
+			event->callback(event->fd, epoll_to_poll(events[i].events),
+					event->data);
 		}
 	}
+	free_removed_fd_events(loop);
 
 	// Dispatch timers
 	if (loop->timers->length) {
-		struct timespec now;
-		clock_gettime(CLOCK_MONOTONIC, &now);
-		for (int i = 0; i < loop->timers->length; ++i) {
-			struct loop_timer *timer = loop->timers->items[i];
-			bool expired = timer->expiry.tv_sec < now.tv_sec ||
-				(timer->expiry.tv_sec == now.tv_sec &&
-				 timer->expiry.tv_nsec < now.tv_nsec);
-			if (expired) {
-				timer->callback(timer->data);
-				loop_remove_timer(loop, timer);
-				--i;
-			}
+		struct loop_timer now = {0};
+		clock_gettime(CLOCK_MONOTONIC, &now.expiry);
+		while (loop->timers->length &&
+				!timer_before(&now, loop->timers->items[0])) {
+			struct loop_timer *timer = loop->timers->items[0];
+			timer_heap_remove(loop->timers, timer);
+			timer->callback(timer->data);
+			free(timer);
 		}
 	}
 }
 
 void loop_add_fd(struct loop *loop, int fd, short mask,
 		void (*callback)(int fd, short mask, void *data), void *data) {
+	if (fd >= loop->fd_capacity) {
+		int capacity = loop->fd_capacity ? loop->fd_capacity : 16;
+		while (capacity <= fd) {
+			capacity *= 2;
+		}
+		struct loop_fd_event **fd_events = realloc(loop->fd_events,
+				sizeof(struct loop_fd_event *) * capacity);
+		if (!fd_events) {
+			sway_log(SWAY_ERROR, "Unable to allocate memory for event");
+			return;
+		}
+		memset(&fd_events[loop->fd_capacity], 0,
+				sizeof(struct loop_fd_event *) * (capacity - loop->fd_capacity));
+		loop->fd_events = fd_events;
+		loop->fd_capacity = capacity;
+	}
+
 	struct loop_fd_event *event = calloc(1, sizeof(struct loop_fd_event));
 	if (!event) {
 		sway_log(SWAY_ERROR, "Unable to allocate memory for event");
 		return;
 	}
+	event->fd = fd;
 	event->callback = callback;
 	event->data = data;
-	list_add(loop->fd_events, event);
 
-	struct pollfd pfd = {fd, mask, 0};
+	// The fd may have been closed and reused without being removed
+	loop_remove_fd(loop, fd);
 
-	if (loop->fd_length == loop->fd_capacity) {
-		loop->fd_capacity += 10;
-		loop->fds = realloc(loop->fds,
-				sizeof(struct pollfd) * loop->fd_capacity);
+	struct epoll_event epoll_event = {
+		.events = poll_to_epoll(mask),
+		.data.ptr = event,
+	};
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &epoll_event) == -1) {
+		sway_log_errno(SWAY_ERROR, "Unable to add fd %d to the loop", fd);
+		free(event);
+		return;
 	}
-
-	loop->fds[loop->fd_length++] = pfd;
+	loop->fd_events[fd] = event;
 }
 
 struct loop_timer *loop_add_timer(struct loop *loop, int ms,
@@ -145,31 +277,34 @@ struct loop_timer *loop_add_timer(struct loop *loop, int ms,
 	}
 	timer->expiry.tv_nsec += nsec;
 
+	timer->index = loop->timers->length;
 	list_add(loop->timers, timer);
+	timer_heap_sift_up(loop->timers, timer->index);
 
 	return timer;
 }
 
 bool loop_remove_fd(struct loop *loop, int fd) {
-	for (int i = 0; i < loop->fd_length; ++i) {
-		if (loop->fds[i].fd == fd) {
-			free(loop->fd_events->items[i]);
-			list_del(loop->fd_events, i);
-
-			loop->fd_length--;
-			memmove(&loop->fds[i], &loop->fds[i + 1],
-					sizeof(struct pollfd) * (loop->fd_length - i));
-
-			return true;
-		}
+	if (fd < 0 || fd >= loop->fd_capacity || !loop->fd_events[fd]) {
+		return false;
 	}
-	return false;
+	struct loop_fd_event *event = loop->fd_events[fd];
+	loop->fd_events[fd] = NULL;
+	// Fails if the fd was already closed, which removed it from epoll
+	epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+	// Freed once the current dispatch is done
+	event->fd = -1;
+	list_add(loop->removed_fd_events, event);
+	return true;
 }
 
 bool loop_remove_timer(struct loop *loop, struct loop_timer *timer) {
+	// The timer may already have expired and been freed, so look it up by
+	// address before touching it
 	for (int i = 0; i < loop->timers->length; ++i) {
 		if (loop->timers->items[i] == timer) {
-			list_del(loop->timers, i);
+			timer_heap_remove(loop->timers, timer);
 			free(timer);
 			return true;
 		}
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <cairo/cairo.h>
 #include <pango/pangocairo.h>
 #include <stdarg.h>
@@ -7,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "cairo.h"
+#include "hash.h"
 #include "log.h"
 #include "stringop.h"
 
@@ -82,57 +84,278 @@ PangoLayout *get_pango_layout(cairo_t *cairo, const char *font,
 	return layout;
 }
 
+/**
+ * Cache of layouts keyed by font, scale, markup and text. Titlebars and bar
+ * blocks are measured and drawn with the same few strings over and over, so
+ * this saves parsing the markup and font description and shaping the text
+ * each time. Text sizes are cached along with the layouts, for the last few
+ * transformations and font options they were measured with, so that outputs
+ * with different subpixel orders don't keep measuring the same text again.
+ *
+ * Pango objects may only be used from the thread which created them, so each
+ * thread has a cache of its own.
+ */
+#define TEXT_CACHE_SIZE 128
+#define TEXT_CACHE_SIZES 4
+
+struct text_size {
+	bool measured;
+	unsigned long options_hash;
+	cairo_matrix_t matrix;
+	int width, height, baseline;
+};
+
+struct text_cache_entry {
+	struct text_cache_entry *prev, *next; // most recently used first
+	char *font;
+	char *text;
+	double scale;
+	bool markup;
+
+	// pango_printf applies the cairo font options to its layout while
+	// get_text_size doesn't, so they get separate layouts. Sharing one would
+	// make pango relayout the text whenever they alternate.
+	PangoLayout *size_layout;
+	PangoLayout *draw_layout;
+
+	struct text_size sizes[TEXT_CACHE_SIZES];
+	int next_size; // the slot replaced by the next measurement
+};
+
+struct text_cache {
+	hash_t *entries; // struct text_cache_entry -> struct text_cache_entry
+	struct text_cache_entry *head, *tail;
+};
+
+static _Thread_local struct text_cache text_cache = {0};
+
+static uint32_t text_cache_entry_hash(const void *key) {
+	const struct text_cache_entry *entry = key;
+	uint32_t hash = hash_str(entry->text) * 31 + hash_str(entry->font);
+	hash = hash * 31 + (uint32_t)(entry->scale * 1000);
+	return hash * 2 + entry->markup;
+}
+
+static bool text_cache_entry_equal(const void *a, const void *b) {
+	const struct text_cache_entry *entry_a = a, *entry_b = b;
+	return entry_a->scale == entry_b->scale &&
+		entry_a->markup == entry_b->markup &&
+		strcmp(entry_a->text, entry_b->text) == 0 &&
+		strcmp(entry_a->font, entry_b->font) == 0;
+}
+
+static void text_cache_unlink(struct text_cache_entry *entry) {
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		text_cache.head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		text_cache.tail = entry->prev;
+	}
+	entry->prev = entry->next = NULL;
+}
+
+static void text_cache_push(struct text_cache_entry *entry) {
+	entry->next = text_cache.head;
+	if (text_cache.head) {
+		text_cache.head->prev = entry;
+	} else {
+		text_cache.tail = entry;
+	}
+	text_cache.head = entry;
+}
+
+static void text_cache_entry_destroy(struct text_cache_entry *entry) {
+	if (entry->size_layout) {
+		g_object_unref(entry->size_layout);
+	}
+	if (entry->draw_layout) {
+		g_object_unref(entry->draw_layout);
+	}
+	free(entry->font);
+	free(entry->text);
+	free(entry);
+}
+
+void text_cache_fini(void) {
+	struct text_cache_entry *entry = text_cache.head;
+	while (entry) {
+		struct text_cache_entry *next = entry->next;
+		text_cache_entry_destroy(entry);
+		entry = next;
+	}
+	hash_free(text_cache.entries);
+	text_cache.entries = NULL;
+	text_cache.head = text_cache.tail = NULL;
+}
+
+static struct text_cache_entry *text_cache_get(const char *font,
+		const char *text, double scale, bool markup) {
+	if (!text_cache.entries) {
+		text_cache.entries =
+			create_hash(text_cache_entry_hash, text_cache_entry_equal);
+	}
+	struct text_cache_entry key = {
+		.font = (char *)font,
+		.text = (char *)text,
+		.scale = scale,
+		.markup = markup,
+	};
+	struct text_cache_entry *entry = hash_get(text_cache.entries, &key);
+	if (entry) {
+		if (entry != text_cache.head) {
+			text_cache_unlink(entry);
+			text_cache_push(entry);
+		}
+		return entry;
+	}
+
+	entry = calloc(1, sizeof(struct text_cache_entry));
+	if (!entry) {
+		sway_log(SWAY_ERROR, "Failed to allocate memory");
+		return NULL;
+	}
+	entry->font = strdup(font);
+	entry->text = strdup(text);
+	entry->scale = scale;
+	entry->markup = markup;
+	hash_set(text_cache.entries, entry, entry);
+	text_cache_push(entry);
+
+	if (text_cache.entries->length > TEXT_CACHE_SIZE) {
+		struct text_cache_entry *last = text_cache.tail;
+		hash_del(text_cache.entries, last);
+		text_cache_unlink(last);
+		text_cache_entry_destroy(last);
+	}
+	return entry;
+}
+
+static unsigned long get_font_options_hash(cairo_t *cairo) {
+	// Pango combines the options of the target surface and the cairo context
+	cairo_font_options_t *fo = cairo_font_options_create();
+	cairo_surface_get_font_options(cairo_get_target(cairo), fo);
+	cairo_font_options_t *cairo_fo = cairo_font_options_create();
+	cairo_get_font_options(cairo, cairo_fo);
+	cairo_font_options_merge(fo, cairo_fo);
+	unsigned long hash = cairo_font_options_hash(fo);
+	cairo_font_options_destroy(cairo_fo);
+	cairo_font_options_destroy(fo);
+	return hash;
+}
+
+/**
+ * Format into buf if it fits, otherwise into a newly allocated string.
+ */
+static char *format_text(char *buf, size_t size, const char *fmt,
+		va_list args) {
+	va_list args_copy;
+	va_copy(args_copy, args);
+	// Add one since vsnprintf excludes null terminator.
+	size_t length = vsnprintf(buf, size, fmt, args_copy) + 1;
+	va_end(args_copy);
+	if (length <= size) {
+		return buf;
+	}
+
+	char *text = malloc(length);
+	if (text == NULL) {
+		sway_log(SWAY_ERROR, "Failed to allocate memory");
+		return NULL;
+	}
+	vsnprintf(text, length, fmt, args);
+	return text;
+}
+
 void get_text_size(cairo_t *cairo, const char *font, int *width, int *height,
 		int *baseline, double scale, bool markup, const char *fmt, ...) {
+	char buf[256];
 	va_list args;
 	va_start(args, fmt);
-	// Add one since vsnprintf excludes null terminator.
-	int length = vsnprintf(NULL, 0, fmt, args) + 1;
+	char *text = format_text(buf, sizeof(buf), fmt, args);
 	va_end(args);
-
-	char *buf = malloc(length);
-	if (buf == NULL) {
-		sway_log(SWAY_ERROR, "Failed to allocate memory");
+	if (!text) {
 		return;
 	}
-	va_start(args, fmt);
-	vsnprintf(buf, length, fmt, args);
-	va_end(args);
 
-	PangoLayout *layout = get_pango_layout(cairo, font, buf, scale, markup);
-	pango_cairo_update_layout(cairo, layout);
-	pango_layout_get_pixel_size(layout, width, height);
+	struct text_cache_entry *entry = text_cache_get(font, text, scale, markup);
+	if (!entry) {
+		goto out;
+	}
+	if (!entry->size_layout) {
+		entry->size_layout = get_pango_layout(cairo, font, text, scale, markup);
+	}
+
+	unsigned long options_hash = get_font_options_hash(cairo);
+	cairo_matrix_t matrix;
+	cairo_get_matrix(cairo, &matrix);
+	struct text_size *size = NULL;
+	for (int i = 0; i < TEXT_CACHE_SIZES && !size; ++i) {
+		struct text_size *slot = &entry->sizes[i];
+		if (slot->measured && slot->options_hash == options_hash &&
+				memcmp(&slot->matrix, &matrix, sizeof(matrix)) == 0) {
+			size = slot;
+		}
+	}
+	if (!size) {
+		size = &entry->sizes[entry->next_size];
+		entry->next_size = (entry->next_size + 1) % TEXT_CACHE_SIZES;
+		pango_cairo_update_layout(cairo, entry->size_layout);
+		pango_layout_get_pixel_size(entry->size_layout,
+				&size->width, &size->height);
+		size->baseline =
+			pango_layout_get_baseline(entry->size_layout) / PANGO_SCALE;
+		size->options_hash = options_hash;
+		size->matrix = matrix;
+		size->measured = true;
+	}
+
+	if (width) {
+		*width = size->width;
+	}
+	if (height) {
+		*height = size->height;
+	}
 	if (baseline) {
-		*baseline = pango_layout_get_baseline(layout) / PANGO_SCALE;
+		*baseline = size->baseline;
+	}
+out:
+	if (text != buf) {
+		free(text);
 	}
-	g_object_unref(layout);
-	free(buf);
 }
 
 void pango_printf(cairo_t *cairo, const char *font,
 		double scale, bool markup, const char *fmt, ...) {
+	char buf[256];
 	va_list args;
 	va_start(args, fmt);
-	// Add one since vsnprintf excludes null terminator.
-	int length = vsnprintf(NULL, 0, fmt, args) + 1;
+	char *text = format_text(buf, sizeof(buf), fmt, args);
 	va_end(args);
-
-	char *buf = malloc(length);
-	if (buf == NULL) {
-		sway_log(SWAY_ERROR, "Failed to allocate memory");
+	if (!text) {
 		return;
 	}
-	va_start(args, fmt);
-	vsnprintf(buf, length, fmt, args);
-	va_end(args);
 
-	PangoLayout *layout = get_pango_layout(cairo, font, buf, scale, markup);
+	struct text_cache_entry *entry = text_cache_get(font, text, scale, markup);
+	if (!entry) {
+		goto out;
+	}
+	if (!entry->draw_layout) {
+		entry->draw_layout = get_pango_layout(cairo, font, text, scale, markup);
+	}
+
 	cairo_font_options_t *fo = cairo_font_options_create();
 	cairo_get_font_options(cairo, fo);
-	pango_cairo_context_set_font_options(pango_layout_get_context(layout), fo);
+	pango_cairo_context_set_font_options(
+			pango_layout_get_context(entry->draw_layout), fo);
 	cairo_font_options_destroy(fo);
-	pango_cairo_update_layout(cairo, layout);
-	pango_cairo_show_layout(cairo, layout);
-	g_object_unref(layout);
-	free(buf);
+	pango_cairo_update_layout(cairo, entry->draw_layout);
+	pango_cairo_show_layout(cairo, entry->draw_layout);
+out:
+	if (text != buf) {
+		free(text);
+	}
 }
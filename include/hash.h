@@ -0,0 +1,47 @@
+#ifndef _SWAY_HASH_H
+#define _SWAY_HASH_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct hash_entry;
+
+/* A hash table mapping keys to values. Keys are not copied, so they must stay
+ * valid until they are removed or replaced. Passing NULL for both the hash and
+ * the equal functions compares the key pointers themselves, which allows using
+ * integers cast to pointers as keys.
+ */
+typedef struct {
+	int capacity;
+	int length;
+	struct hash_entry **buckets;
+	uint32_t (*hash)(const void *key);
+	bool (*equal)(const void *a, const void *b);
+} hash_t;
+
+hash_t *create_hash(uint32_t (*hash)(const void *key),
+		bool (*equal)(const void *a, const void *b));
+void hash_free(hash_t *hash);
+// Return the value for the key or NULL if there is none
+void *hash_get(hash_t *hash, const void *key);
+// Add the key or replace both the stored key and value if it already exists
+void hash_set(hash_t *hash, const void *key, void *value);
+// Remove the key and return its value, or NULL if it wasn't found
+void *hash_del(hash_t *hash, const void *key);
+void hash_for_each(hash_t *hash,
+		void (*f)(const void *key, void *value, void *data), void *data);
+
+// Initial value for hash_bytes
+#define HASH_SEED 2166136261u
+
+// Continue the hash given as the seed with len bytes of data, so several
+// values can be hashed one after the other
+uint32_t hash_bytes(uint32_t seed, const void *data, size_t len);
+
+// Hash and equal functions for NUL terminated string keys
+uint32_t hash_str(const void *key);
+bool hash_str_equal(const void *a, const void *b);
+// Same as above, but ASCII case insensitive (see strcasecmp)
+uint32_t hash_str_case(const void *key);
+bool hash_str_case_equal(const void *a, const void *b);
+#endif
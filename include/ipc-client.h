@@ -25,6 +25,12 @@ char *get_socketpath(void);
  * Opens the sway socket.
  */
 int ipc_open_socket(const char *socket_path);
+/**
+ * Sends an IPC message without waiting for the reply, which has to be read
+ * with ipc_recv_response.
+ */
+void ipc_send_request(int socketfd, uint32_t type, const char *payload,
+		uint32_t len);
 /**
  * Issues a single IPC command and returns the buffer. len will be updated with
  * the length of the buffer returned from sway.
@@ -43,4 +49,45 @@ void free_ipc_response(struct ipc_response *response);
  */
 bool ipc_set_recv_timeout(int socketfd, struct timeval tv);
 
+struct loop;
+struct ipc_client;
+
+/**
+ * Handles a reply or an event. The response is freed once this returns.
+ */
+typedef void (*ipc_response_handler_t)(struct ipc_response *response,
+		void *data);
+
+/**
+ * Wraps a connected IPC socket for use without blocking. Requests are queued
+ * and written as the socket accepts them, and replies are parsed as they
+ * arrive. Replies are passed to the handler given with their request, since
+ * sway answers requests in order, and events are passed to handle_event. Once
+ * the connection is closed or broken, handle_event is called with NULL.
+ *
+ * If a loop is given, the socket is read and written from it. Otherwise the
+ * caller does so with ipc_client_dispatch and ipc_client_flush. The socket
+ * is made non-blocking and stays owned by the caller.
+ */
+struct ipc_client *ipc_client_create(int socketfd, struct loop *loop,
+		ipc_response_handler_t handle_event, void *data);
+void ipc_client_destroy(struct ipc_client *client);
+/**
+ * Queues a request. Its reply is passed to handle_reply, which may be NULL if
+ * the reply doesn't matter.
+ */
+void ipc_client_send(struct ipc_client *client, uint32_t type,
+		const char *payload, uint32_t len,
+		ipc_response_handler_t handle_reply, void *data);
+/**
+ * Reads whatever is available and handles the complete messages. Returns
+ * false once the connection is gone.
+ */
+bool ipc_client_dispatch(struct ipc_client *client);
+/**
+ * Writes as much of the queued requests as the socket accepts. Returns false
+ * once the connection is gone.
+ */
+bool ipc_client_flush(struct ipc_client *client);
+
 #endif
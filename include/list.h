@@ -1,5 +1,6 @@
 #ifndef _SWAY_LIST_H
 #define _SWAY_LIST_H
+#include <stdbool.h>
 
 typedef struct {
 	int capacity;
@@ -27,6 +28,17 @@ void list_swap(list_t *list, int src, int dest);
 // move item to end of list
 void list_move_to_end(list_t *list, void *item);
 
+// Return true if both lists contain the same items in the same order
+bool list_items_equal(list_t *a, list_t *b);
+
+/* Reference counted, immutable copies of lists. A snapshot must not be
+ * modified with the functions above or freed with list_free, and is freed
+ * once its last reference is dropped. Passing NULL creates an empty snapshot.
+ */
+list_t *create_list_snapshot(list_t *source);
+list_t *list_snapshot_ref(list_t *snapshot);
+void list_snapshot_unref(list_t *snapshot);
+
 /* Calls `free` for each item in the list, then frees the list.
  * Do not use this to free lists of primitives or items that require more
  * complicated deallocation code.
@@ -26,10 +26,28 @@ typedef void (*terminate_callback_t)(int exit_code);
 
 // Will log all messages less than or equal to `verbosity`
 // The `terminate` callback is called by `sway_abort`
+// Per source path overrides are read from $SWAY_LOG_FILTER, see
+// sway_log_set_filter
 void sway_log_init(sway_log_importance_t verbosity, terminate_callback_t terminate);
 
-void _sway_log(sway_log_importance_t verbosity, const char *format, ...) ATTRIB_PRINTF(2, 3);
-void _sway_vlog(sway_log_importance_t verbosity, const char *format, va_list args) ATTRIB_PRINTF(2, 0);
+// Sets per source path log levels from a comma separated list of
+// `prefix=level` pairs, e.g. "sway/desktop/=debug,sway/ipc-server.c=error".
+// The longest matching prefix of the source path wins.
+void sway_log_set_filter(const char *spec);
+
+// Moves writing log messages to a background thread. Messages are formatted
+// into fixed size records in a lock-free ring buffer and written to stderr by
+// the thread. If the ring buffer is full the caller waits for the thread to
+// catch up. Whatever is left in the ring is written out on a fatal signal.
+bool sway_log_start_async(void);
+
+// Blocks until all queued log messages have been written
+void sway_log_flush(void);
+
+void _sway_log(sway_log_importance_t verbosity, const char *file, int line,
+		const char *format, ...) ATTRIB_PRINTF(4, 5);
+void _sway_vlog(sway_log_importance_t verbosity, const char *file, int line,
+		const char *format, va_list args) ATTRIB_PRINTF(4, 0);
 void _sway_abort(const char *filename, ...) ATTRIB_PRINTF(1, 2);
 bool _sway_assert(bool condition, const char* format, ...) ATTRIB_PRINTF(2, 3);
 
@@ -37,10 +55,10 @@ bool _sway_assert(bool condition, const char* format, ...) ATTRIB_PRINTF(2, 3);
 const char *_sway_strip_path(const char *filepath);
 
 #define sway_log(verb, fmt, ...) \
-	_sway_log(verb, "[%s:%d] " fmt, _sway_strip_path(__FILE__), __LINE__, ##__VA_ARGS__)
+	_sway_log(verb, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
 
 #define sway_vlog(verb, fmt, args) \
-	_sway_vlog(verb, "[%s:%d] " fmt, _sway_strip_path(__FILE__), __LINE__, args)
+	_sway_vlog(verb, __FILE__, __LINE__, fmt, args)
 
 #define sway_log_errno(verb, fmt, ...) \
 	sway_log(verb, fmt ": %s", ##__VA_ARGS__, strerror(errno))
@@ -19,5 +19,10 @@ void get_text_size(cairo_t *cairo, const char *font, int *width, int *height,
 		int *baseline, double scale, bool markup, const char *fmt, ...);
 void pango_printf(cairo_t *cairo, const char *font,
 		double scale, bool markup, const char *fmt, ...);
+/**
+ * Free the calling thread's cache of text layouts. Each thread that renders
+ * text should call this before it exits.
+ */
+void text_cache_fini(void);
 
 #endif
@@ -6,6 +6,8 @@
 #include <stdint.h>
 #include <wayland-client.h>
 
+#define POOL_BUFFERS_MAX 4
+
 struct pool_buffer {
 	struct wl_buffer *buffer;
 	cairo_surface_t *surface;
@@ -14,11 +16,39 @@ struct pool_buffer {
 	uint32_t width, height;
 	void *data;
 	size_t size;
+	size_t offset, capacity; // region of the pool backing the buffer
 	bool busy;
 };
 
+/**
+ * A set of buffers sub-allocated from a single shm file and mapping. Buffers
+ * keep their region of the pool when they are resized to a size which fits
+ * in it, and the pool grows when they don't.
+ */
+struct buffer_pool {
+	struct wl_shm_pool *shm_pool;
+	int fd;
+	void *data;
+	size_t size; // of the file and mapping
+	size_t used; // end of the last region handed out
+	size_t length; // number of buffers in use, up to POOL_BUFFERS_MAX
+	struct pool_buffer buffers[POOL_BUFFERS_MAX];
+};
+
+/**
+ * Prepare a pool which starts out with length buffers. Further buffers are
+ * added when all of them are busy, so frames aren't dropped when the
+ * compositor holds on to buffers.
+ */
+void init_buffer_pool(struct buffer_pool *pool, size_t length);
+void finish_buffer_pool(struct buffer_pool *pool);
+
+/**
+ * Return a buffer which isn't busy, with the given size. Its contents are
+ * left over from whatever was last drawn in it, unless the size changed.
+ * Returns NULL when all of the buffers are busy.
+ */
 struct pool_buffer *get_next_buffer(struct wl_shm *shm,
-		struct pool_buffer pool[static 2], uint32_t width, uint32_t height);
-void destroy_buffer(struct pool_buffer *buffer);
+		struct buffer_pool *pool, uint32_t width, uint32_t height);
 
 #endif
@@ -338,6 +338,12 @@ enum sway_popup_during_fullscreen {
 	POPUP_LEAVE,
 };
 
+enum xwayland_mode {
+	XWAYLAND_MODE_DISABLED,
+	XWAYLAND_MODE_LAZY,
+	XWAYLAND_MODE_IMMEDIATE,
+};
+
 enum command_context {
 	CONTEXT_CONFIG = 1,
 	CONTEXT_BINDING = 2,
@@ -459,7 +465,7 @@ struct sway_config {
 	size_t urgent_timeout;
 	enum sway_fowa focus_on_window_activation;
 	enum sway_popup_during_fullscreen popup_during_fullscreen;
-	bool xwayland;
+	enum xwayland_mode xwayland;
 
 	// swaybg
 	char *swaybg_command;
@@ -659,10 +665,18 @@ void free_bar_binding(struct bar_binding *binding);
 
 void free_workspace_config(struct workspace_config *wsc);
 
+/**
+ * Add or remove a container's title height and baseline from the ones
+ * config_update_font_height takes the maximum of.
+ */
+void config_track_title_height(size_t height, size_t baseline);
+
+void config_untrack_title_height(size_t height, size_t baseline);
+
 /**
  * Updates the value of config->font_height based on the max title height
- * reported by each container. If recalculate is true, the containers will
- * recalculate their heights before reporting.
+ * tracked for the containers. If recalculate is true, the containers will
+ * recalculate their heights first.
  *
  * If the height has changed, all containers will be rearranged to take on the
  * new size.
@@ -0,0 +1,80 @@
+#ifndef _SWAY_DESKTOP_TEXT_WORKER_H
+#define _SWAY_DESKTOP_TEXT_WORKER_H
+#include <stdbool.h>
+#include <wayland-server-protocol.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_box.h>
+
+/**
+ * Text textures (titles and marks) and canvases made up of text, such as
+ * tabbed and stacked headers, are rasterized with cairo and pango by a pool of
+ * worker threads, so a burst of title changes doesn't hold up input and frame
+ * handling. The pixels are handed back to the main loop, which uploads them
+ * and swaps them in for the previous texture. Until then the previous texture
+ * stays in use.
+ */
+
+struct text_texture_request {
+	const char *font;
+	const char *text;
+	double scale;
+	bool markup;
+	int height;
+	float background[4];
+	float foreground[4];
+	// Render with full hinting and subpixel antialiasing in this order
+	bool subpixel_aa;
+	enum wl_output_subpixel subpixel;
+};
+
+enum text_canvas_op_type {
+	TEXT_CANVAS_RECT,
+	TEXT_CANVAS_TEXT,
+};
+
+/**
+ * Part of a canvas, which is drawn from solid rects and text in order. Text is
+ * drawn at the top left corner of its box on its background, and clipped to
+ * the box.
+ */
+struct text_canvas_op {
+	enum text_canvas_op_type type;
+	struct wlr_box box;
+	float color[4]; // of a rect
+	struct text_texture_request text; // the height is unused
+};
+
+void text_worker_init(void);
+
+void text_worker_fini(void);
+
+/**
+ * Rasterize the text and replace *texture with the result once it's done,
+ * then call done with the data. A request which is still pending for the same
+ * texture is dropped.
+ */
+void text_worker_update_texture(struct wlr_texture **texture,
+		const struct text_texture_request *request,
+		void (*done)(void *data), void *data);
+
+/**
+ * Rasterize a width by height canvas like a text texture, replacing *texture
+ * once it's done.
+ */
+void text_worker_update_canvas(struct wlr_texture **texture,
+		int width, int height, const struct text_canvas_op *ops,
+		int ops_length, void (*done)(void *data), void *data);
+
+/**
+ * Drop any pending request for the texture. Must be called before the texture
+ * pointer goes away.
+ */
+void text_worker_cancel(struct wlr_texture **texture);
+
+/**
+ * Give up a text texture. It's kept around for reuse by a later request which
+ * renders to the same size, instead of being destroyed right away.
+ */
+void text_worker_release_texture(struct wlr_texture *texture);
+
+#endif
@@ -45,4 +45,9 @@ void transaction_notify_view_ready_by_serial(struct sway_view *view,
 void transaction_notify_view_ready_by_size(struct sway_view *view,
 		int width, int height);
 
+/**
+ * Free the instructions kept for reuse between transactions.
+ */
+void transaction_pool_fini(void);
+
 #endif
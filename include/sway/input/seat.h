@@ -59,6 +59,8 @@ struct sway_seat {
 
 	bool has_focus;
 	struct wl_list focus_stack; // list of containers in focus order
+	uint64_t focus_cache_epoch;
+	uint64_t focus_cache_tag;
 	struct sway_workspace *workspace;
 	char *prev_workspace_name; // for workspace back_and_forth
 
@@ -180,6 +182,12 @@ struct sway_container *seat_get_focus_inactive_view(struct sway_seat *seat,
 struct sway_node *seat_get_active_tiling_child(struct sway_seat *seat,
 		struct sway_node *parent);
 
+/**
+ * Mark the focus-inactive queries of every seat as stale. Must be called
+ * whenever a focus stack or the structure of the tree changes.
+ */
+void seat_invalidate_focus_cache(void);
+
 /**
  * Iterate over the focus-inactive children of the container calling the
  * function on each.
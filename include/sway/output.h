@@ -37,6 +37,7 @@ struct sway_output {
 	list_t *workspaces;
 
 	struct sway_output_state current;
+	list_t *workspaces_snapshot; // see sway_container::children_snapshot
 
 	struct wl_listener destroy;
 	struct wl_listener mode;
@@ -150,6 +151,10 @@ void render_rect(struct sway_output *output,
 
 void premultiply_alpha(float color[4], float opacity);
 
+struct header_cache;
+
+void header_cache_destroy(struct header_cache *cache);
+
 void scale_box(struct wlr_box *box, float scale);
 
 enum wlr_direction opposite_direction(enum wlr_direction d);
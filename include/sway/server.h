@@ -89,6 +89,8 @@ struct sway_debug {
 		DAMAGE_HIGHLIGHT,  // Highlight regions of the screen being damaged
 		DAMAGE_RERENDER,   // Render the full output when any damage occurs
 	} damage;
+	int damage_rects;      // Merge damage into this many rects, -1 to disable
+	int damage_pass_cost;  // Area worth drawing to save a pass over the damage
 };
 
 struct sway_debug debug;
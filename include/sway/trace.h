@@ -0,0 +1,66 @@
+#ifndef _SWAY_TRACE_H
+#define _SWAY_TRACE_H
+#include <json.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum sway_trace_point {
+	TRACE_TRANSACTION_COMMIT,
+	TRACE_TRANSACTION_APPLY,
+	TRACE_OUTPUT_RENDER,
+	TRACE_NODE_AT_COORDS,
+	TRACE_EXECUTE_COMMAND,
+	TRACE_IPC_MESSAGE,
+	TRACE_VIEW_MAP,
+	TRACE_POINT_LAST,
+};
+
+/**
+ * A single trace record. Records are stored in binary form in a fixed size
+ * ring buffer and are only converted to text when the trace is dumped, so the
+ * oldest records are overwritten once the buffer is full.
+ */
+struct sway_trace_record {
+	uint64_t start_ns;
+	uint32_t duration_ns;
+	uint32_t arg;
+	enum sway_trace_point point;
+};
+
+extern bool trace_enabled;
+
+#define TRACE_MAX_RECORDS (1 << 20)
+
+/**
+ * Allocate the ring buffer and enable tracing. The capacity is clamped to
+ * TRACE_MAX_RECORDS and rounded up to a power of two.
+ */
+bool trace_init(size_t capacity);
+
+void trace_fini(void);
+
+uint64_t trace_now(void);
+
+void trace_record(enum sway_trace_point point, uint64_t start_ns, uint32_t arg);
+
+/**
+ * Start and end a trace span. When tracing is disabled this is a single
+ * branch on a global.
+ */
+#define trace_begin() (trace_enabled ? trace_now() : 0)
+
+#define trace_end(point, start, arg) \
+	do { \
+		if (start) { \
+			trace_record(point, start, arg); \
+		} \
+	} while (0)
+
+/**
+ * Returns the recorded spans in the Chrome trace event format, which can be
+ * loaded into chrome://tracing or Perfetto.
+ */
+json_object *trace_get_json(void);
+
+#endif
@@ -9,6 +9,8 @@
 
 struct sway_view;
 struct sway_seat;
+struct border_colors;
+struct text_texture_request;
 
 enum sway_container_layout {
 	L_NONE,
@@ -72,6 +74,10 @@ struct sway_container {
 	// This means most places of the code can refer to the main variables (pending state) and it'll just work.
 	struct sway_container_state current;
 
+	// The most recent snapshot of children handed to a transaction. It is
+	// shared with instructions and the current state until children changes.
+	list_t *children_snapshot;
+
 	char *title;           // The view's title (unformatted)
 	char *formatted_title; // The title displayed in the title bar
 
@@ -146,6 +152,12 @@ struct sway_container {
 	struct wlr_texture *marks_focused_inactive;
 	struct wlr_texture *marks_unfocused;
 	struct wlr_texture *marks_urgent;
+	// Bumped whenever one of the title or marks textures is redrawn
+	uint32_t texture_serial;
+
+	// The titlebars of the children when the layout is tabbed or stacked,
+	// rendered once and reused until they change
+	struct header_cache *header_cache;
 
 	struct {
 		struct wl_signal destroy;
@@ -191,12 +203,26 @@ void container_update_textures_recursive(struct sway_container *con);
 
 void container_damage_whole(struct sway_container *container);
 
+/**
+ * Damage only the container's titlebar and borders, for changes which don't
+ * affect its content, such as the title, marks or urgency.
+ */
+void container_damage_decorations(struct sway_container *container);
+
 void container_reap_empty(struct sway_container *con);
 
 struct sway_container *container_flatten(struct sway_container *container);
 
 void container_update_title_textures(struct sway_container *container);
 
+/**
+ * Fill in the request used to rasterize the container's title, or its marks,
+ * in the given colours. The text is allocated for the caller to free. Returns
+ * false if there is nothing to draw.
+ */
+bool container_get_text_request(struct sway_container *container, bool marks,
+		struct border_colors *class, struct text_texture_request *request);
+
 /**
  * Calculate the container's title_height property.
  */
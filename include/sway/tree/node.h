@@ -1,6 +1,7 @@
 #ifndef _SWAY_NODE_H
 #define _SWAY_NODE_H
 #include <stdbool.h>
+#include <stdint.h>
 #include "list.h"
 
 struct sway_root;
@@ -40,6 +41,17 @@ struct sway_node {
 	// the current.
 	bool dirty;
 
+	// Results of the seat focus_stack queries for this node. Only valid for
+	// the seat whose focus_cache_tag matches the tag, see seat.c.
+	struct {
+		uint64_t tag;
+		struct sway_node *focus_inactive;
+		struct sway_node *focus_inactive_view;
+		struct sway_node *active_tiling_child;
+		struct sway_container *focus_inactive_tiling;
+		struct sway_container *focus_inactive_floating;
+	} focus_cache;
+
 	struct {
 		struct wl_signal destroy;
 	} events;
@@ -47,6 +59,17 @@ struct sway_node {
 
 void node_init(struct sway_node *node, enum sway_node_type type, void *thing);
 
+/**
+ * Release what node_init set up. Must be called before freeing the node.
+ */
+void node_finish(struct sway_node *node);
+
+/**
+ * Return the node with the given ID, or NULL if there is no such node or it is
+ * being destroyed.
+ */
+struct sway_node *node_from_id(size_t id);
+
 const char *node_type_to_str(enum sway_node_type type);
 
 /**
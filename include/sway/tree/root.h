@@ -7,6 +7,7 @@
 #include "sway/tree/container.h"
 #include "sway/tree/node.h"
 #include "config.h"
+#include "hash.h"
 #include "list.h"
 
 extern struct sway_root *root;
@@ -30,6 +31,10 @@ struct sway_root {
 	list_t *outputs; // struct sway_output
 	list_t *scratchpad; // struct sway_container
 
+	// Indexes for looking up containers by mark and workspaces by name
+	hash_t *marks; // char * -> struct sway_container
+	hash_t *workspaces; // char * -> struct sway_workspace
+
 	// For when there's no connected outputs
 	struct sway_output *noop_output;
 
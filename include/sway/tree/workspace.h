@@ -43,6 +43,12 @@ struct sway_workspace {
 	bool urgent;
 
 	struct sway_workspace_state current;
+	// See sway_container::children_snapshot
+	list_t *floating_snapshot;
+	list_t *tiling_snapshot;
+
+	// See sway_container::header_cache
+	struct header_cache *header_cache;
 };
 
 struct workspace_config *workspace_find_config(const char *ws_name);
@@ -56,6 +62,11 @@ void workspace_destroy(struct sway_workspace *workspace);
 
 void workspace_begin_destroy(struct sway_workspace *workspace);
 
+/**
+ * Replace the name of the workspace, taking ownership of the new name.
+ */
+void workspace_set_name(struct sway_workspace *workspace, char *name);
+
 void workspace_consider_destroy(struct sway_workspace *ws);
 
 char *workspace_next_name(const char *output_name);
@@ -1,6 +1,7 @@
 #ifndef SWAY_XWAYLAND_H
 #define SWAY_XWAYLAND_H
 
+#include <stdbool.h>
 #include <wlr/xwayland.h>
 #include <xcb/xproto.h>
 
@@ -22,6 +23,7 @@ enum atom_name {
 struct sway_xwayland {
 	struct wlr_xwayland *wlr_xwayland;
 	struct wlr_xcursor_manager *xcursor_manager;
+	bool ready;
 
 	xcb_atom_t atoms[ATOM_LAST];
 };
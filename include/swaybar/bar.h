@@ -3,6 +3,7 @@
 #include <wayland-client.h>
 #include "config.h"
 #include "input.h"
+#include "list.h"
 #include "pool-buffer.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "xdg-output-unstable-v1-client-protocol.h"
@@ -34,11 +35,18 @@ struct swaybar {
 
 	struct swaybar_config *config;
 	struct status_line *status;
+	// Rasterized status lines shared by outputs, see render.c
+	list_t *status_renders;
 
 	struct loop *eventloop;
 
 	int ipc_event_socketfd;
 	int ipc_socketfd;
+	// Reads the event socket from the event loop once the bar is set up, and
+	// sends the requests which the bar doesn't wait for
+	struct ipc_client *ipc_client;
+	// A GET_WORKSPACES request is waiting for its reply on the event socket
+	bool workspaces_pending;
 
 	struct wl_list outputs; // swaybar_output::link
 	struct wl_list seats; // swaybar_seat::link
@@ -50,6 +58,32 @@ struct swaybar {
 	bool running;
 };
 
+/**
+ * A part of the bar which is drawn from its own inputs, such as a workspace
+ * button or a status block. The whole bar is still recorded every frame, but a
+ * region is only rasterized into the buffer and damaged when the hash of those
+ * inputs or its position changes.
+ */
+struct swaybar_region {
+	double x, width; // buffer-local
+	uint32_t hash;
+	bool matched;
+};
+
+#define SWAYBAR_DAMAGE_RANGES 8
+
+/**
+ * The damaged columns of the bar. Regions span the full height of the bar, so
+ * damage is tracked as ranges of x coordinates in buffer-local pixels.
+ */
+struct swaybar_damage {
+	bool whole;
+	int length;
+	struct {
+		int x1, x2;
+	} ranges[SWAYBAR_DAMAGE_RANGES];
+};
+
 struct swaybar_output {
 	struct wl_list link; // swaybar::outputs
 	struct swaybar *bar;
@@ -70,16 +104,26 @@ struct swaybar_output {
 	uint32_t width, height;
 	int32_t scale;
 	enum wl_output_subpixel subpixel;
-	struct pool_buffer buffers[2];
+	struct buffer_pool buffers;
 	struct pool_buffer *current_buffer;
 	bool dirty;
 	bool frame_scheduled;
 
+	list_t *regions; // struct swaybar_region, as of the last frame
+	list_t *new_regions; // struct swaybar_region, while rendering a frame
+	uint32_t frame_hash; // hash of the inputs shared by the whole bar
+	struct swaybar_damage frame_damage;
+	// Damage not yet committed to the surface, and not yet painted into
+	// each of the buffers
+	struct swaybar_damage surface_damage;
+	struct swaybar_damage buffer_damage[POOL_BUFFERS_MAX];
+
 	uint32_t output_height, output_width, output_x, output_y;
 };
 
 struct swaybar_workspace {
 	struct wl_list link; // swaybar_output::workspaces
+	int id;
 	int num;
 	char *name;
 	char *label;
@@ -107,6 +151,7 @@ void set_bar_dirty(struct swaybar *bar);
  * Returns true if the bar is now visible, otherwise false.
  */
 bool determine_bar_visibility(struct swaybar *bar, bool moving_layer);
+void free_workspace(struct swaybar_workspace *ws);
 void free_workspaces(struct wl_list *list);
 
 #endif
@@ -1,6 +1,8 @@
 #ifndef _SWAYBAR_TRAY_ICON_H
 #define _SWAYBAR_TRAY_ICON_H
 
+#include <time.h>
+#include "hash.h"
 #include "list.h"
 
 enum subdir_type {
@@ -26,6 +28,13 @@ struct icon_theme {
 
 	char *dir;
 	list_t *subdirs; // struct icon_theme_subdir *
+
+	// icon name -> list_t of struct icon_location *, built on first lookup
+	hash_t *icons;
+	// Modification time of each basedir and subdir pair when it was indexed,
+	// zero for those which don't exist
+	struct timespec *dir_mtimes;
+	time_t checked; // when dir_mtimes were last compared
 };
 
 void init_themes(list_t **themes, list_t **basedirs);
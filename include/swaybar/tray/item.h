@@ -14,12 +14,44 @@ struct swaybar_pixmap {
 	unsigned char pixels[];
 };
 
+/**
+ * The icon scaled for drawing at an ideal size, which depends on the height,
+ * scale and tray padding of the bar. Outputs with the same ideal size share it.
+ */
+struct swaybar_scaled_icon {
+	int ideal_size;
+	int size;
+	cairo_surface_t *surface;
+};
+
+enum sni_property {
+	SNI_STATUS,
+	SNI_ICON_NAME,
+	SNI_ICON_PIXMAP,
+	SNI_ATTENTION_ICON_NAME,
+	SNI_ATTENTION_ICON_PIXMAP,
+	SNI_ITEM_IS_MENU,
+	SNI_MENU,
+	SNI_ICON_THEME_PATH,
+	SNI_PROPERTY_COUNT
+};
+
+struct swaybar_sni;
+
+// A pending Get call for a single property
+struct sni_get_property {
+	struct swaybar_sni *sni;
+	enum sni_property property;
+	sd_bus_slot *slot;
+};
+
 struct swaybar_sni {
 	// icon properties
 	struct swaybar_tray *tray;
 	cairo_surface_t *icon;
 	int min_size;
 	int max_size;
+	list_t *scaled_icons; // struct swaybar_scaled_icon *, most recent first
 
 	// dbus properties
 	char *watcher_id;
@@ -36,6 +68,11 @@ struct swaybar_sni {
 	char *menu;
 	char *icon_theme_path; // non-standard KDE property
 
+	sd_bus_slot *get_all_slot; // pending GetAll call
+	struct sni_get_property get_property[SNI_PROPERTY_COUNT];
+	struct loop_timer *refresh_timer;
+	uint32_t pending_properties; // properties to fetch when the timer fires
+
 	sd_bus_slot *new_icon_slot;
 	sd_bus_slot *new_attention_icon_slot;
 	sd_bus_slot *new_status_slot;
@@ -25,6 +25,7 @@ struct swaybar_tray {
 	struct swaybar_host host_xdg;
 	struct swaybar_host host_kde;
 	list_t *items; // struct swaybar_sni *
+	uint32_t serial; // bumped whenever the items need to be redrawn
 	struct swaybar_watcher *watcher_xdg;
 	struct swaybar_watcher *watcher_kde;
 
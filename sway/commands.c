@@ -10,6 +10,7 @@
 #include "sway/config.h"
 #include "sway/criteria.h"
 #include "sway/security.h"
+#include "sway/trace.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
 #include "sway/tree/view.h"
@@ -214,6 +215,7 @@ list_t *execute_command(char *_exec, struct sway_seat *seat,
 	}
 
 	config->handler_context.seat = seat;
+	uint64_t trace_start = trace_begin();
 
 	head = exec;
 	do {
@@ -301,6 +303,7 @@ list_t *execute_command(char *_exec, struct sway_seat *seat,
 cleanup:
 	free(exec);
 	list_free(views);
+	trace_end(TRACE_EXECUTE_COMMAND, trace_start, res_list->length);
 	return res_list;
 }
 
@@ -152,11 +152,6 @@ static void container_swap(struct sway_container *con1,
 	}
 }
 
-static bool test_con_id(struct sway_container *container, void *data) {
-	size_t *con_id = data;
-	return container->node.id == *con_id;
-}
-
 #if HAVE_XWAYLAND
 static bool test_id(struct sway_container *container, void *data) {
 	xcb_window_t *wid = data;
@@ -165,14 +160,6 @@ static bool test_id(struct sway_container *container, void *data) {
 }
 #endif
 
-static bool test_mark(struct sway_container *container, void *mark) {
-	if (container->marks->length) {
-		return !list_seq_find(container->marks,
-				(int (*)(const void *, const void *))strcmp, mark);
-	}
-	return false;
-}
-
 struct cmd_results *cmd_swap(int argc, char **argv) {
 	struct cmd_results *error = NULL;
 	if ((error = checkarg(argc, "swap", EXPECTED_AT_LEAST, 4))) {
@@ -197,10 +184,12 @@ struct cmd_results *cmd_swap(int argc, char **argv) {
 		other = root_find_container(test_id, &id);
 #endif
 	} else if (strcasecmp(argv[2], "con_id") == 0) {
-		size_t con_id = atoi(value);
-		other = root_find_container(test_con_id, &con_id);
+		struct sway_node *node = node_from_id(atoi(value));
+		if (node && node->type == N_CONTAINER) {
+			other = node->sway_container;
+		}
 	} else if (strcasecmp(argv[2], "mark") == 0) {
-		other = root_find_container(test_mark, value);
+		other = container_find_mark(value);
 	} else {
 		free(value);
 		return cmd_results_new(CMD_INVALID, expected_syntax);
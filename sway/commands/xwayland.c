@@ -1,3 +1,4 @@
+#include <strings.h>
 #include "sway/config.h"
 #include "log.h"
 #include "sway/commands.h"
@@ -11,7 +12,16 @@ struct cmd_results *cmd_xwayland(int argc, char **argv) {
 	}
 
 #ifdef HAVE_XWAYLAND
-	bool xwayland = parse_boolean(argv[0], true);
+	enum xwayland_mode xwayland;
+	if (strcasecmp(argv[0], "force") == 0) {
+		xwayland = XWAYLAND_MODE_IMMEDIATE;
+	} else if (strcasecmp(argv[0], "lazy") == 0 ||
+			parse_boolean(argv[0], true)) {
+		xwayland = XWAYLAND_MODE_LAZY;
+	} else {
+		xwayland = XWAYLAND_MODE_DISABLED;
+	}
+
 	if (config->reloading && config->xwayland != xwayland) {
 		return cmd_results_new(CMD_FAILURE,
 				"xwayland can only be enabled/disabled at launch");
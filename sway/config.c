@@ -12,6 +12,7 @@
 #include <libinput.h>
 #include <limits.h>
 #include <dirent.h>
+#include <string.h>
 #include <strings.h>
 #include <linux/input-event-codes.h>
 #include <wlr/types/wlr_output.h>
@@ -247,7 +248,7 @@ static void config_defaults(struct sway_config *config) {
 	config->font_height = 17; // height of monospace 10
 	config->urgent_timeout = 500;
 	config->popup_during_fullscreen = POPUP_SMART;
-	config->xwayland = true;
+	config->xwayland = XWAYLAND_MODE_LAZY;
 
 	config->titlebar_border_thickness = 1;
 	config->titlebar_h_padding = 5;
@@ -956,31 +957,80 @@ int workspace_output_cmp_workspace(const void *a, const void *b) {
 	return lenient_strcmp(wsa->workspace, wsb->workspace);
 }
 
-static void find_font_height_iterator(struct sway_container *con, void *data) {
-	size_t amount_below_baseline = con->title_height - con->title_baseline;
-	size_t extended_height = config->font_baseline + amount_below_baseline;
-	if (extended_height > config->font_height) {
-		config->font_height = extended_height;
+/**
+ * The number of containers for each title baseline and each amount a title
+ * extends below its baseline. Titles are only a few dozen pixels high, so a
+ * count per pixel value keeps the maximums up to date in constant time when a
+ * single title changes.
+ */
+struct title_height_counts {
+	size_t *counts;
+	size_t length;
+	size_t max;
+};
+
+static struct title_height_counts title_baselines = {0};
+static struct title_height_counts title_descents = {0};
+
+static void title_height_counts_add(struct title_height_counts *counts,
+		size_t value) {
+	if (value >= counts->length) {
+		size_t length = value + 16;
+		size_t *new_counts = realloc(counts->counts, length * sizeof(size_t));
+		if (!sway_assert(new_counts, "Unable to allocate title heights")) {
+			return;
+		}
+		memset(&new_counts[counts->length], 0,
+				(length - counts->length) * sizeof(size_t));
+		counts->counts = new_counts;
+		counts->length = length;
+	}
+	counts->counts[value]++;
+	if (value > counts->max) {
+		counts->max = value;
 	}
 }
 
-static void find_baseline_iterator(struct sway_container *con, void *data) {
-	bool *recalculate = data;
-	if (*recalculate) {
-		container_calculate_title_height(con);
+static void title_height_counts_remove(struct title_height_counts *counts,
+		size_t value) {
+	if (!sway_assert(value < counts->length && counts->counts[value],
+				"Removing untracked title height %zu", value)) {
+		return;
 	}
-	if (con->title_baseline > config->font_baseline) {
-		config->font_baseline = con->title_baseline;
+	counts->counts[value]--;
+	while (counts->max > 0 && counts->counts[counts->max] == 0) {
+		counts->max--;
 	}
 }
 
+static size_t title_descent(size_t height, size_t baseline) {
+	return height > baseline ? height - baseline : 0;
+}
+
+void config_track_title_height(size_t height, size_t baseline) {
+	title_height_counts_add(&title_baselines, baseline);
+	title_height_counts_add(&title_descents, title_descent(height, baseline));
+}
+
+void config_untrack_title_height(size_t height, size_t baseline) {
+	title_height_counts_remove(&title_baselines, baseline);
+	title_height_counts_remove(&title_descents,
+			title_descent(height, baseline));
+}
+
+static void calculate_title_height_iterator(struct sway_container *con,
+		void *data) {
+	container_calculate_title_height(con);
+}
+
 void config_update_font_height(bool recalculate) {
 	size_t prev_max_height = config->font_height;
-	config->font_height = 0;
-	config->font_baseline = 0;
 
-	root_for_each_container(find_baseline_iterator, &recalculate);
-	root_for_each_container(find_font_height_iterator, NULL);
+	if (recalculate) {
+		root_for_each_container(calculate_title_height_iterator, NULL);
+	}
+	config->font_baseline = title_baselines.max;
+	config->font_height = title_baselines.max + title_descents.max;
 
 	if (config->font_height != prev_max_height) {
 		arrange_root();
@@ -236,6 +236,9 @@ list_t *criteria_for_view(struct sway_view *view, enum criteria_type types) {
 struct match_data {
 	struct criteria *criteria;
 	list_t *matches;
+	// Containers with a mark matching con_mark, looked up in root->marks
+	hash_t *candidates; // struct sway_container * -> itself
+	struct sway_container *candidate; // any one of them
 };
 
 static void criteria_get_views_iterator(struct sway_container *container,
@@ -248,13 +251,60 @@ static void criteria_get_views_iterator(struct sway_container *container,
 	}
 }
 
+static void criteria_find_marked_iterator(const void *mark,
+		void *value, void *data) {
+	struct sway_container *con = value;
+	struct match_data *match_data = data;
+	if (con->view && !con->node.destroying &&
+			regex_cmp(mark, match_data->criteria->con_mark) == 0) {
+		// Containers with several marks are in the index once per mark
+		hash_set(match_data->candidates, con, con);
+		match_data->candidate = con;
+	}
+}
+
+static void criteria_get_marked_views_iterator(
+		struct sway_container *container, void *data) {
+	struct match_data *match_data = data;
+	if (hash_get(match_data->candidates, container)) {
+		criteria_get_views_iterator(container, data);
+	}
+}
+
+/**
+ * Find the views matching criteria with a con_mark. The containers with a
+ * matching mark come from the mark index, but the tree is still walked to
+ * return them in tree order, unless there are none or just one.
+ */
+static void criteria_get_marked_views(struct match_data *data) {
+	data->candidates = create_hash(NULL, NULL);
+	hash_for_each(root->marks, criteria_find_marked_iterator, data);
+	if (data->candidates->length == 1) {
+		criteria_get_views_iterator(data->candidate, data);
+	} else if (data->candidates->length > 1) {
+		root_for_each_container(criteria_get_marked_views_iterator, data);
+	}
+	hash_free(data->candidates);
+}
+
 list_t *criteria_get_views(struct criteria *criteria) {
 	list_t *matches = create_list();
 	struct match_data data = {
 		.criteria = criteria,
 		.matches = matches,
 	};
-	root_for_each_container(criteria_get_views_iterator, &data);
+	// Avoid walking the tree when the criteria can only match a container
+	// which is found through the node ID or mark indexes
+	if (criteria->con_id) {
+		struct sway_node *node = node_from_id(criteria->con_id);
+		if (node && node->type == N_CONTAINER) {
+			criteria_get_views_iterator(node->sway_container, &data);
+		}
+	} else if (criteria->con_mark) {
+		criteria_get_marked_views(&data);
+	} else {
+		root_for_each_container(criteria_get_views_iterator, &data);
+	}
 	return matches;
 }
 
@@ -1,6 +1,9 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
 #include <time.h>
 #include <wayland-server.h>
@@ -16,11 +19,14 @@
 #include "log.h"
 #include "config.h"
 #include "sway/config.h"
+#include "sway/desktop.h"
+#include "sway/desktop/text_worker.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
 #include "sway/layers.h"
 #include "sway/output.h"
 #include "sway/server.h"
+#include "sway/trace.h"
 #include "sway/tree/arrange.h"
 #include "sway/tree/container.h"
 #include "sway/tree/root.h"
@@ -70,6 +76,103 @@ static void scissor_output(struct wlr_output *wlr_output,
 	wlr_renderer_scissor(renderer, &box);
 }
 
+#define RECT_BATCH_COLORS 16
+
+struct rect_batch_entry {
+	float color[4];
+	pixman_region32_t region;
+};
+
+/**
+ * Solid rects (borders, titlebar backgrounds, indicators) are queued per colour
+ * and only drawn when something has to go on top of them or the frame ends.
+ * Touching rects of the same colour merge into fewer boxes, and each colour is
+ * clipped against the damage once, drawing the clipped boxes directly instead
+ * of scissoring the whole rect once per damage rect.
+ */
+static struct {
+	struct sway_output *output;
+	pixman_region32_t *damage;
+	pixman_region32_t pending; // union of every queued rect
+	struct rect_batch_entry entries[RECT_BATCH_COLORS];
+	int length;
+} rect_batch;
+
+static void rect_batch_flush(void) {
+	if (rect_batch.length == 0) {
+		return;
+	}
+	struct wlr_output *wlr_output = rect_batch.output->wlr_output;
+	struct wlr_renderer *renderer =
+		wlr_backend_get_renderer(wlr_output->backend);
+
+	// The boxes are already clipped to the damage
+	wlr_renderer_scissor(renderer, NULL);
+
+	for (int i = 0; i < rect_batch.length; ++i) {
+		struct rect_batch_entry *entry = &rect_batch.entries[i];
+		pixman_region32_intersect(&entry->region, &entry->region,
+			rect_batch.damage);
+
+		int nrects;
+		pixman_box32_t *rects =
+			pixman_region32_rectangles(&entry->region, &nrects);
+		for (int j = 0; j < nrects; ++j) {
+			struct wlr_box box = {
+				.x = rects[j].x1,
+				.y = rects[j].y1,
+				.width = rects[j].x2 - rects[j].x1,
+				.height = rects[j].y2 - rects[j].y1,
+			};
+			wlr_render_rect(renderer, &box, entry->color,
+				wlr_output->transform_matrix);
+		}
+		pixman_region32_fini(&entry->region);
+	}
+	rect_batch.length = 0;
+	pixman_region32_clear(&rect_batch.pending);
+}
+
+static void rect_batch_begin(struct sway_output *output,
+		pixman_region32_t *damage) {
+	rect_batch.output = output;
+	rect_batch.damage = damage;
+	rect_batch.length = 0;
+	pixman_region32_init(&rect_batch.pending);
+}
+
+static void rect_batch_end(void) {
+	rect_batch_flush();
+	pixman_region32_fini(&rect_batch.pending);
+	rect_batch.output = NULL;
+	rect_batch.damage = NULL;
+}
+
+/**
+ * Returns true if the box can be drawn along with the queued rects of its
+ * colour without changing the result. Colours are drawn in the order they were
+ * first queued, so the box may only overlap rects of its own colour, and only
+ * if it's opaque.
+ */
+static bool rect_batch_can_merge(struct rect_batch_entry *entry,
+		pixman_box32_t *box, float color[static 4]) {
+	if (pixman_region32_contains_rectangle(&rect_batch.pending, box) ==
+			PIXMAN_REGION_OUT) {
+		return true;
+	}
+	if (!entry || color[3] < 1.0f) {
+		return false;
+	}
+	for (int i = 0; i < rect_batch.length; ++i) {
+		struct rect_batch_entry *other = &rect_batch.entries[i];
+		if (other != entry && pixman_region32_contains_rectangle(
+					&other->region, box) != PIXMAN_REGION_OUT) {
+			return false;
+		}
+	}
+	return true;
+}
+
 static void render_texture(struct wlr_output *wlr_output,
 		pixman_region32_t *output_damage, struct wlr_texture *texture,
 		const struct wlr_box *box, const float matrix[static 9], float alpha) {
@@ -86,6 +189,9 @@ static void render_texture(struct wlr_output *wlr_output,
 		goto damage_finish;
 	}
 
+	// Queued rects are below the texture
+	rect_batch_flush();
+
 	int nrects;
 	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
 	for (int i = 0; i < nrects; ++i) {
@@ -159,35 +265,62 @@ static void render_drag_icons(struct sway_output *output,
 void render_rect(struct sway_output *output,
 		pixman_region32_t *output_damage, const struct wlr_box *_box,
 		float color[static 4]) {
+	if (!sway_assert(rect_batch.output == output,
+				"render_rect called outside of output_render")) {
+		return;
+	}
 	struct wlr_output *wlr_output = output->wlr_output;
-	struct wlr_renderer *renderer =
-		wlr_backend_get_renderer(wlr_output->backend);
 
 	struct wlr_box box;
 	memcpy(&box, _box, sizeof(struct wlr_box));
 	box.x -= output->lx * wlr_output->scale;
 	box.y -= output->ly * wlr_output->scale;
+	if (box.width <= 0 || box.height <= 0) {
+		return;
+	}
 
-	pixman_region32_t damage;
-	pixman_region32_init(&damage);
-	pixman_region32_union_rect(&damage, &damage, box.x, box.y,
-		box.width, box.height);
-	pixman_region32_intersect(&damage, &damage, output_damage);
-	bool damaged = pixman_region32_not_empty(&damage);
-	if (!damaged) {
-		goto damage_finish;
+	pixman_box32_t rect = {
+		.x1 = box.x,
+		.y1 = box.y,
+		.x2 = box.x + box.width,
+		.y2 = box.y + box.height,
+	};
+	if (pixman_region32_contains_rectangle(output_damage, &rect) ==
+			PIXMAN_REGION_OUT) {
+		return;
 	}
 
-	int nrects;
-	pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
-	for (int i = 0; i < nrects; ++i) {
-		scissor_output(wlr_output, &rects[i]);
-		wlr_render_rect(renderer, &box, color,
-			wlr_output->transform_matrix);
+	if (output_damage != rect_batch.damage) {
+		rect_batch_flush();
+		rect_batch.damage = output_damage;
 	}
 
-damage_finish:
-	pixman_region32_fini(&damage);
+	struct rect_batch_entry *entry = NULL;
+	for (int i = 0; i < rect_batch.length; ++i) {
+		if (memcmp(rect_batch.entries[i].color, color,
+					sizeof(float) * 4) == 0) {
+			entry = &rect_batch.entries[i];
+			break;
+		}
+	}
+
+	if (!rect_batch_can_merge(entry, &rect, color)) {
+		rect_batch_flush();
+		entry = NULL;
+	}
+	if (!entry) {
+		if (rect_batch.length == RECT_BATCH_COLORS) {
+			rect_batch_flush();
+		}
+		entry = &rect_batch.entries[rect_batch.length++];
+		memcpy(entry->color, color, sizeof(float) * 4);
+		pixman_region32_init(&entry->region);
+	}
+
+	pixman_region32_union_rect(&entry->region, &entry->region,
+		box.x, box.y, box.width, box.height);
+	pixman_region32_union_rect(&rect_batch.pending, &rect_batch.pending,
+		box.x, box.y, box.width, box.height);
 }
 
 void premultiply_alpha(float color[4], float opacity) {
@@ -336,6 +469,80 @@ static void render_view(struct sway_output *output, pixman_region32_t *damage,
 	}
 }
 
+/**
+ * While recording, render_titlebar adds what it would draw to a canvas for the
+ * text worker instead of drawing it, see render_header.
+ */
+static struct {
+	bool recording;
+	bool failed; // some of it couldn't be recorded
+	struct wlr_box box; // output-buffer-local
+	struct text_canvas_op *ops;
+	int length, capacity;
+} header_canvas;
+
+static struct text_canvas_op *header_canvas_add(enum text_canvas_op_type type,
+		const struct wlr_box *box) {
+	if (box->width <= 0 || box->height <= 0) {
+		return NULL;
+	}
+	if (header_canvas.length == header_canvas.capacity) {
+		int capacity = header_canvas.capacity ? header_canvas.capacity * 2 : 32;
+		struct text_canvas_op *ops = realloc(header_canvas.ops,
+				capacity * sizeof(struct text_canvas_op));
+		if (!ops) {
+			header_canvas.failed = true;
+			return NULL;
+		}
+		header_canvas.ops = ops;
+		header_canvas.capacity = capacity;
+	}
+	struct text_canvas_op *op = &header_canvas.ops[header_canvas.length++];
+	memset(op, 0, sizeof(struct text_canvas_op));
+	op->type = type;
+	op->box = *box;
+	op->box.x -= header_canvas.box.x;
+	op->box.y -= header_canvas.box.y;
+	return op;
+}
+
+// Same coordinates as render_rect
+static void titlebar_rect(struct sway_output *output,
+		pixman_region32_t *output_damage, const struct wlr_box *box,
+		float color[static 4]) {
+	if (!header_canvas.recording) {
+		render_rect(output, output_damage, box, color);
+		return;
+	}
+	float scale = output->wlr_output->scale;
+	struct wlr_box ob_box = *box;
+	ob_box.x -= output->lx * scale;
+	ob_box.y -= output->ly * scale;
+	struct text_canvas_op *op = header_canvas_add(TEXT_CANVAS_RECT, &ob_box);
+	if (op) {
+		memcpy(op->color, color, sizeof(float) * 4);
+	}
+}
+
+/**
+ * Draw the container's title or marks texture at the top left corner of the
+ * output-buffer-local box, clipped to the box.
+ */
+static void titlebar_text(struct sway_output *output,
+		pixman_region32_t *output_damage, struct sway_container *con,
+		struct border_colors *colors, bool marks, struct wlr_texture *texture,
+		const struct wlr_box *box, const float matrix[static 9]) {
+	if (!header_canvas.recording) {
+		render_texture(output->wlr_output, output_damage, texture,
+			box, matrix, con->alpha);
+		return;
+	}
+	struct text_canvas_op *op = header_canvas_add(TEXT_CANVAS_TEXT, box);
+	if (op && !container_get_text_request(con, marks, colors, &op->text)) {
+		header_canvas.length--;
+	}
+}
+
 /**
  * Render a titlebar.
  *
@@ -374,7 +581,7 @@ static void render_titlebar(struct sway_output *output,
 	box.width = width;
 	box.height = titlebar_border_thickness;
 	scale_box(&box, output_scale);
-	render_rect(output, output_damage, &box, color);
+	titlebar_rect(output, output_damage, &box, color);
 
 	// Single pixel bar below title
 	size_t left_offset = 0, right_offset = 0;
@@ -392,7 +599,7 @@ static void render_titlebar(struct sway_output *output,
 	box.width = width - left_offset - right_offset;
 	box.height = titlebar_border_thickness;
 	scale_box(&box, output_scale);
-	render_rect(output, output_damage, &box, color);
+	titlebar_rect(output, output_damage, &box, color);
 
 	if (layout == L_TABBED) {
 		// Single pixel left edge
@@ -402,7 +609,7 @@ static void render_titlebar(struct sway_output *output,
 		box.height =
 			container_titlebar_height() - titlebar_border_thickness * 2;
 		scale_box(&box, output_scale);
-		render_rect(output, output_damage, &box, color);
+		titlebar_rect(output, output_damage, &box, color);
 
 		// Single pixel right edge
 		box.x = x + width - titlebar_border_thickness;
@@ -411,7 +618,7 @@ static void render_titlebar(struct sway_output *output,
 		box.height =
 			container_titlebar_height() - titlebar_border_thickness * 2;
 		scale_box(&box, output_scale);
-		render_rect(output, output_damage, &box, color);
+		titlebar_rect(output, output_damage, &box, color);
 	}
 
 	int inner_x = x - output_x + titlebar_h_padding;
@@ -460,8 +667,8 @@ static void render_titlebar(struct sway_output *output,
 		if (ob_inner_width < texture_box.width) {
 			texture_box.width = ob_inner_width;
 		}
-		render_texture(output->wlr_output, output_damage, marks_texture,
-			&texture_box, matrix, con->alpha);
+		titlebar_text(output, output_damage, con, colors, true,
+			marks_texture, &texture_box, matrix);
 
 		// Padding above
 		memcpy(&color, colors->background, sizeof(float) * 4);
@@ -470,12 +677,12 @@ static void render_titlebar(struct sway_output *output,
 		box.y = round((y + titlebar_border_thickness) * output_scale);
 		box.width = texture_box.width;
 		box.height = ob_padding_above;
-		render_rect(output, output_damage, &box, color);
+		titlebar_rect(output, output_damage, &box, color);
 
 		// Padding below
 		box.y += ob_padding_above + texture_box.height;
 		box.height = ob_padding_below;
-		render_rect(output, output_damage, &box, color);
+		titlebar_rect(output, output_damage, &box, color);
 	}
 
 	// Title text
@@ -528,8 +735,8 @@ static void render_titlebar(struct sway_output *output,
 			texture_box.width = ob_inner_width - ob_marks_width;
 		}
 
-		render_texture(output->wlr_output, output_damage, title_texture,
-			&texture_box, matrix, con->alpha);
+		titlebar_text(output, output_damage, con, colors, false,
+			title_texture, &texture_box, matrix);
 
 		// Padding above
 		memcpy(&color, colors->background, sizeof(float) * 4);
@@ -538,12 +745,12 @@ static void render_titlebar(struct sway_output *output,
 		box.y = round((y + titlebar_border_thickness) * output_scale);
 		box.width = texture_box.width;
 		box.height = ob_padding_above;
-		render_rect(output, output_damage, &box, color);
+		titlebar_rect(output, output_damage, &box, color);
 
 		// Padding below
 		box.y += ob_padding_above + texture_box.height;
 		box.height = ob_padding_below;
-		render_rect(output, output_damage, &box, color);
+		titlebar_rect(output, output_damage, &box, color);
 	}
 
 	// Determine the left + right extends of the textures (output-buffer local)
@@ -577,7 +784,7 @@ static void render_titlebar(struct sway_output *output,
 		box.x = ob_left_x + ob_left_width + round(output_x * output_scale);
 		box.y = round(bg_y * output_scale);
 		box.height = ob_bg_height;
-		render_rect(output, output_damage, &box, color);
+		titlebar_rect(output, output_damage, &box, color);
 	}
 
 	// Padding on left side
@@ -592,7 +799,7 @@ static void render_titlebar(struct sway_output *output,
 	if (box.x + box.width < left_x) {
 		box.width += left_x - box.x - box.width;
 	}
-	render_rect(output, output_damage, &box, color);
+	titlebar_rect(output, output_damage, &box, color);
 
 	// Padding on right side
 	right_offset = (layout == L_TABBED) * titlebar_border_thickness;
@@ -607,7 +814,7 @@ static void render_titlebar(struct sway_output *output,
 		box.width += box.x - right_rx;
 		box.x = right_rx;
 	}
-	render_rect(output, output_damage, &box, color);
+	titlebar_rect(output, output_damage, &box, color);
 
 	if (connects_sides) {
 		// Left pixel in line with bottom bar
@@ -616,7 +823,7 @@ static void render_titlebar(struct sway_output *output,
 		box.width = state->border_thickness * state->border_left;
 		box.height = titlebar_border_thickness;
 		scale_box(&box, output_scale);
-		render_rect(output, output_damage, &box, color);
+		titlebar_rect(output, output_damage, &box, color);
 
 		// Right pixel in line with bottom bar
 		box.x = x + width - state->border_thickness * state->border_right;
@@ -624,7 +831,7 @@ static void render_titlebar(struct sway_output *output,
 		box.width = state->border_thickness * state->border_right;
 		box.height = titlebar_border_thickness;
 		scale_box(&box, output_scale);
-		render_rect(output, output_damage, &box, color);
+		titlebar_rect(output, output_damage, &box, color);
 	}
 }
 
@@ -659,6 +866,7 @@ struct parent_data {
 	list_t *children;
 	bool focused;
 	struct sway_container *active_child;
+	struct header_cache **header_cache;
 };
 
 static void render_container(struct sway_output *output,
@@ -716,47 +924,44 @@ static void render_containers_linear(struct sway_output *output,
 }
 
 /**
- * Render a container's children using the L_TABBED layout.
+ * Pick the colours and textures for a child's titlebar in a tabbed or stacked
+ * header.
  */
-static void render_containers_tabbed(struct sway_output *output,
-		pixman_region32_t *damage, struct parent_data *parent) {
-	if (!parent->children->length) {
-		return;
+static struct border_colors *header_child_colors(struct parent_data *parent,
+		struct sway_container *child, struct wlr_texture **title_texture,
+		struct wlr_texture **marks_texture) {
+	struct sway_view *view = child->view;
+	bool urgent = view ?
+		view_is_urgent(view) : container_has_urgent_child(child);
+
+	if (urgent) {
+		*title_texture = child->title_urgent;
+		*marks_texture = child->marks_urgent;
+		return &config->border_colors.urgent;
+	} else if (child->current.focused || parent->focused) {
+		*title_texture = child->title_focused;
+		*marks_texture = child->marks_focused;
+		return &config->border_colors.focused;
+	} else if (child == parent->active_child) {
+		*title_texture = child->title_focused_inactive;
+		*marks_texture = child->marks_focused_inactive;
+		return &config->border_colors.focused_inactive;
 	}
-	struct sway_container *current = parent->active_child;
-	struct border_colors *current_colors = &config->border_colors.unfocused;
-	int tab_width = parent->box.width / parent->children->length;
+	*title_texture = child->title_unfocused;
+	*marks_texture = child->marks_unfocused;
+	return &config->border_colors.unfocused;
+}
 
-	// Render tabs
+static void render_tabbed_titlebars(struct sway_output *output,
+		pixman_region32_t *damage, struct parent_data *parent) {
+	int tab_width = parent->box.width / parent->children->length;
 	for (int i = 0; i < parent->children->length; ++i) {
 		struct sway_container *child = parent->children->items[i];
-		struct sway_view *view = child->view;
-		struct sway_container_state *cstate = &child->current;
-		struct border_colors *colors;
-		struct wlr_texture *title_texture;
-		struct wlr_texture *marks_texture;
-		bool urgent = view ?
-			view_is_urgent(view) : container_has_urgent_child(child);
+		struct wlr_texture *title_texture, *marks_texture;
+		struct border_colors *colors = header_child_colors(parent, child,
+				&title_texture, &marks_texture);
 
-		if (urgent) {
-			colors = &config->border_colors.urgent;
-			title_texture = child->title_urgent;
-			marks_texture = child->marks_urgent;
-		} else if (cstate->focused || parent->focused) {
-			colors = &config->border_colors.focused;
-			title_texture = child->title_focused;
-			marks_texture = child->marks_focused;
-		} else if (child == parent->active_child) {
-			colors = &config->border_colors.focused_inactive;
-			title_texture = child->title_focused_inactive;
-			marks_texture = child->marks_focused_inactive;
-		} else {
-			colors = &config->border_colors.unfocused;
-			title_texture = child->title_unfocused;
-			marks_texture = child->marks_unfocused;
-		}
-
-		int x = cstate->x + tab_width * i;
+		int x = child->current.x + tab_width * i;
 
 		// Make last tab use the remaining width of the parent
 		if (i == parent->children->length - 1) {
@@ -765,70 +970,272 @@ static void render_containers_tabbed(struct sway_output *output,
 
 		render_titlebar(output, damage, child, x, parent->box.y, tab_width,
 				colors, title_texture, marks_texture);
-
-		if (child == current) {
-			current_colors = colors;
-		}
 	}
+}
 
-	// Render surface and left/right/bottom borders
-	if (current->view) {
-		render_view(output, damage, current, current_colors);
-	} else {
-		render_container(output, damage, current,
-				parent->focused || current->current.focused);
+static void render_stacked_titlebars(struct sway_output *output,
+		pixman_region32_t *damage, struct parent_data *parent) {
+	size_t titlebar_height = container_titlebar_height();
+	for (int i = 0; i < parent->children->length; ++i) {
+		struct sway_container *child = parent->children->items[i];
+		struct wlr_texture *title_texture, *marks_texture;
+		struct border_colors *colors = header_child_colors(parent, child,
+				&title_texture, &marks_texture);
+
+		int y = parent->box.y + titlebar_height * i;
+		render_titlebar(output, damage, child, parent->box.x, y,
+				parent->box.width, colors, title_texture, marks_texture);
 	}
 }
 
 /**
- * Render a container's children using the L_STACKED layout.
+ * A tabbed or stacked header is kept as a single texture, rasterized offscreen
+ * by the text worker, and drawn in one go until anything it shows changes.
+ * Everything which goes into the header's pixels is part of the key, colours
+ * by value so changing them in the config is noticed.
  */
-static void render_containers_stacked(struct sway_output *output,
-		pixman_region32_t *damage, struct parent_data *parent) {
-	if (!parent->children->length) {
+struct header_cache_key {
+	struct sway_output *output;
+	struct wlr_box box; // output-buffer-local
+	enum sway_container_layout layout;
+	int length;
+	int font_height;
+	int font_baseline;
+	int titlebar_border_thickness;
+	int titlebar_h_padding;
+	int titlebar_v_padding;
+	enum alignment title_align;
+	bool show_marks;
+};
+
+struct header_cache_child {
+	struct border_colors colors;
+	struct wlr_texture *title_texture;
+	struct wlr_texture *marks_texture;
+	uint32_t texture_serial;
+	size_t title_baseline;
+	int border_thickness;
+	bool view;
+	bool border_left;
+	bool border_right;
+};
+
+struct header_cache {
+	struct header_cache_key key;
+	struct header_cache_child *children;
+	struct wlr_texture *texture;
+	bool ready; // false while the texture for the key is being rasterized
+	struct wlr_box damage_box; // layout-local, damaged once it's ready
+};
+
+// Scratch space for the key of the header being rendered
+static struct header_cache_child *header_children;
+static int header_children_capacity;
+
+void header_cache_destroy(struct header_cache *cache) {
+	if (!cache) {
 		return;
 	}
-	struct sway_container *current = parent->active_child;
-	struct border_colors *current_colors = &config->border_colors.unfocused;
-	size_t titlebar_height = container_titlebar_height();
+	text_worker_cancel(&cache->texture);
+	text_worker_release_texture(cache->texture);
+	free(cache->children);
+	free(cache);
+}
 
-	// Render titles
-	for (int i = 0; i < parent->children->length; ++i) {
-		struct sway_container *child = parent->children->items[i];
-		struct sway_view *view = child->view;
-		struct sway_container_state *cstate = &child->current;
-		struct border_colors *colors;
-		struct wlr_texture *title_texture;
-		struct wlr_texture *marks_texture;
-		bool urgent = view ?
-			view_is_urgent(view) : container_has_urgent_child(child);
+static bool colors_are_opaque(struct border_colors *colors) {
+	return colors->border[3] == 1.0f && colors->background[3] == 1.0f;
+}
 
-		if (urgent) {
-			colors = &config->border_colors.urgent;
-			title_texture = child->title_urgent;
-			marks_texture = child->marks_urgent;
-		} else if (cstate->focused || parent->focused) {
-			colors = &config->border_colors.focused;
-			title_texture = child->title_focused;
-			marks_texture = child->marks_focused;
-		} else if (child == parent->active_child) {
-			colors = &config->border_colors.focused_inactive;
-			title_texture = child->title_focused_inactive;
-			marks_texture = child->marks_focused_inactive;
-		} else {
-			colors = &config->border_colors.unfocused;
-			title_texture = child->title_unfocused;
-			marks_texture = child->marks_unfocused;
+/**
+ * Fill in the key for the parent's header, in header_children for the
+ * children. Returns false if the header can't be cached: the cached pixels
+ * have to be exactly what would be rendered, so the header must be opaque,
+ * on a single output with an integer scale and the normal transform.
+ */
+static bool header_cache_key_init(struct header_cache_key *key,
+		struct sway_output *output, struct parent_data *parent) {
+	struct wlr_output *wlr_output = output->wlr_output;
+	float scale = wlr_output->scale;
+	if (debug.damage != DAMAGE_DEFAULT || scale != floorf(scale) ||
+			wlr_output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		return false;
+	}
+
+	int length = parent->children->length;
+	int height = container_titlebar_height();
+	if (parent->layout == L_STACKED) {
+		height *= length;
+	}
+	struct wlr_box *output_box =
+		wlr_output_layout_get_box(root->output_layout, wlr_output);
+	if (!output_box || parent->box.x < output_box->x ||
+			parent->box.y < output_box->y ||
+			parent->box.x + parent->box.width >
+				output_box->x + output_box->width ||
+			parent->box.y + height > output_box->y + output_box->height) {
+		return false;
+	}
+
+	if (length > header_children_capacity) {
+		struct header_cache_child *children = realloc(header_children,
+				length * sizeof(struct header_cache_child));
+		if (!children) {
+			return false;
 		}
+		header_children = children;
+		header_children_capacity = length;
+	}
+	memset(header_children, 0, length * sizeof(struct header_cache_child));
+	for (int i = 0; i < length; ++i) {
+		struct sway_container *child = parent->children->items[i];
+		struct sway_container_state *state = &child->current;
+		// Tabs are placed relative to the children
+		if (child->alpha != 1.0f || (parent->layout == L_TABBED &&
+					state->x != parent->box.x)) {
+			return false;
+		}
+		struct header_cache_child *entry = &header_children[i];
+		struct border_colors *colors = header_child_colors(parent, child,
+				&entry->title_texture, &entry->marks_texture);
+		if (!colors_are_opaque(colors)) {
+			return false;
+		}
+		entry->colors = *colors;
+		entry->texture_serial = child->texture_serial;
+		entry->title_baseline = child->title_baseline;
+		entry->border_thickness = state->border_thickness;
+		entry->view = child->view != NULL;
+		entry->border_left = state->border_left;
+		entry->border_right = state->border_right;
+	}
 
-		int y = parent->box.y + titlebar_height * i;
-		render_titlebar(output, damage, child, parent->box.x, y,
-				parent->box.width, colors, title_texture, marks_texture);
+	memset(key, 0, sizeof(struct header_cache_key));
+	key->output = output;
+	key->box.x = (parent->box.x - output->lx) * scale;
+	key->box.y = (parent->box.y - output->ly) * scale;
+	key->box.width = parent->box.width * scale;
+	key->box.height = height * scale;
+	key->layout = parent->layout;
+	key->length = length;
+	key->font_height = config->font_height;
+	key->font_baseline = config->font_baseline;
+	key->titlebar_border_thickness = config->titlebar_border_thickness;
+	key->titlebar_h_padding = config->titlebar_h_padding;
+	key->titlebar_v_padding = config->titlebar_v_padding;
+	key->title_align = config->title_align;
+	key->show_marks = config->show_marks;
+	return key->box.width > 0 && key->box.height > 0;
+}
 
-		if (child == current) {
-			current_colors = colors;
+static bool header_cache_matches(struct header_cache *cache,
+		struct header_cache_key *key) {
+	return cache &&
+		memcmp(&cache->key, key, sizeof(struct header_cache_key)) == 0 &&
+		memcmp(cache->children, header_children,
+			key->length * sizeof(struct header_cache_child)) == 0;
+}
+
+static void handle_header_ready(void *data) {
+	struct header_cache *cache = data;
+	cache->ready = true;
+	desktop_damage_box(&cache->damage_box);
+}
+
+/**
+ * Record the titlebars of the header and have them rasterized into the cache's
+ * texture, which is used once it's ready.
+ */
+static void header_cache_update(struct sway_output *output,
+		struct parent_data *parent, struct header_cache_key *key,
+		void (*render_titlebars)(struct sway_output *output,
+			pixman_region32_t *damage, struct parent_data *parent)) {
+	struct header_cache *cache = *parent->header_cache;
+	if (!cache) {
+		cache = calloc(1, sizeof(struct header_cache));
+		if (!cache) {
+			return;
 		}
+		*parent->header_cache = cache;
+	}
+	struct header_cache_child *children = realloc(cache->children,
+			key->length * sizeof(struct header_cache_child));
+	if (!children) {
+		return;
+	}
+	memcpy(children, header_children,
+			key->length * sizeof(struct header_cache_child));
+	cache->children = children;
+	cache->key = *key;
+	cache->ready = false;
+	cache->damage_box = parent->box;
+	cache->damage_box.height =
+		key->box.height / output->wlr_output->scale;
+
+	header_canvas.recording = true;
+	header_canvas.failed = false;
+	header_canvas.box = key->box;
+	header_canvas.length = 0;
+	render_titlebars(output, NULL, parent);
+	header_canvas.recording = false;
+
+	if (!header_canvas.failed) {
+		text_worker_update_canvas(&cache->texture, key->box.width,
+				key->box.height, header_canvas.ops, header_canvas.length,
+				handle_header_ready, cache);
+	}
+	for (int i = 0; i < header_canvas.length; ++i) {
+		if (header_canvas.ops[i].type == TEXT_CANVAS_TEXT) {
+			free((char *)header_canvas.ops[i].text.text);
+		}
+	}
+}
+
+/**
+ * Render the titlebars of a tabbed or stacked container, from the cached
+ * header if nothing in it has changed. Otherwise the titlebars are rendered
+ * one by one until the header has been rasterized again.
+ */
+static void render_header(struct sway_output *output,
+		pixman_region32_t *damage, struct parent_data *parent,
+		void (*render_titlebars)(struct sway_output *output,
+			pixman_region32_t *damage, struct parent_data *parent)) {
+	struct header_cache_key key;
+	if (!parent->header_cache ||
+			!header_cache_key_init(&key, output, parent)) {
+		render_titlebars(output, damage, parent);
+		return;
+	}
+
+	struct header_cache *cache = *parent->header_cache;
+	if (!header_cache_matches(cache, &key)) {
+		header_cache_update(output, parent, &key, render_titlebars);
+	} else if (cache->ready && cache->texture) {
+		float matrix[9];
+		wlr_matrix_project_box(matrix, &key.box, WL_OUTPUT_TRANSFORM_NORMAL,
+			0.0, output->wlr_output->transform_matrix);
+		render_texture(output->wlr_output, damage, cache->texture,
+			&key.box, matrix, 1.0f);
+		return;
+	}
+	render_titlebars(output, damage, parent);
+}
+
+/**
+ * Render a container's children using a tabbed or stacked layout: the header
+ * and the active child below it.
+ */
+static void render_containers_tabbed_stacked(struct sway_output *output,
+		pixman_region32_t *damage, struct parent_data *parent) {
+	if (!parent->children->length) {
+		return;
 	}
+	struct sway_container *current = parent->active_child;
+	struct wlr_texture *title_texture, *marks_texture;
+	struct border_colors *current_colors = header_child_colors(parent,
+			current, &title_texture, &marks_texture);
+
+	render_header(output, damage, parent, parent->layout == L_TABBED ?
+			render_tabbed_titlebars : render_stacked_titlebars);
 
 	// Render surface and left/right/bottom borders
 	if (current->view) {
@@ -856,10 +1263,8 @@ static void render_containers(struct sway_output *output,
 		render_containers_linear(output, damage, parent);
 		break;
 	case L_STACKED:
-		render_containers_stacked(output, damage, parent);
-		break;
 	case L_TABBED:
-		render_containers_tabbed(output, damage, parent);
+		render_containers_tabbed_stacked(output, damage, parent);
 		break;
 	}
 }
@@ -877,6 +1282,7 @@ static void render_container(struct sway_output *output,
 		.children = con->current.children,
 		.focused = focused,
 		.active_child = con->current.focused_inactive_child,
+		.header_cache = &con->header_cache,
 	};
 	render_containers(output, damage, &data);
 }
@@ -894,6 +1300,7 @@ static void render_workspace(struct sway_output *output,
 		.children = ws->current.tiling,
 		.focused = focused,
 		.active_child = ws->current.focused_inactive_child,
+		.header_cache = &ws->header_cache,
 	};
 	render_containers(output, damage, &data);
 }
@@ -953,6 +1360,143 @@ static void render_floating(struct sway_output *soutput,
 	}
 }
 
+#define DAMAGE_RECTS_DEFAULT 8
+#define DAMAGE_PASS_COST_DEFAULT (64 * 64)
+// Upper bound on the number of boxes the merge looks at, to keep it cheap
+#define DAMAGE_BOXES_MAX 64
+
+static int64_t box_area(const pixman_box32_t *box) {
+	return (int64_t)(box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static void box_union(pixman_box32_t *dst, const pixman_box32_t *a,
+		const pixman_box32_t *b) {
+	dst->x1 = a->x1 < b->x1 ? a->x1 : b->x1;
+	dst->y1 = a->y1 < b->y1 ? a->y1 : b->y1;
+	dst->x2 = a->x2 > b->x2 ? a->x2 : b->x2;
+	dst->y2 = a->y2 > b->y2 ? a->y2 : b->y2;
+}
+
+static bool box_intersects(const pixman_box32_t *a, const pixman_box32_t *b) {
+	return a->x1 < b->x2 && b->x1 < a->x2 && a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+/**
+ * Grow boxes[i] to cover every box it overlaps, removing those, until it
+ * overlaps none. The damage rects get rendered once each, so they must not
+ * overlap or translucent surfaces would be blended twice. Returns the new
+ * number of boxes.
+ */
+static int damage_boxes_absorb(pixman_box32_t *boxes, int n, int i) {
+	for (int k = 0; k < n; ++k) {
+		if (k == i || !box_intersects(&boxes[i], &boxes[k])) {
+			continue;
+		}
+		box_union(&boxes[i], &boxes[i], &boxes[k]);
+		boxes[k] = boxes[--n];
+		if (i == n) {
+			i = k;
+		}
+		k = -1;
+	}
+	return n;
+}
+
+/**
+ * Find the pair of boxes which is cheapest to merge, where the cost is the
+ * area the bounding box draws on top of both boxes minus the cost of the pass
+ * it saves.
+ */
+static int64_t damage_boxes_cheapest_pair(pixman_box32_t *boxes, int n,
+		int64_t pass_cost, int *a, int *b) {
+	int64_t best = INT64_MAX;
+	for (int i = 0; i < n; ++i) {
+		for (int j = i + 1; j < n; ++j) {
+			pixman_box32_t merged;
+			box_union(&merged, &boxes[i], &boxes[j]);
+			int64_t cost = box_area(&merged) - box_area(&boxes[i]) -
+				box_area(&boxes[j]) - pass_cost;
+			if (cost < best) {
+				best = cost;
+				*a = i;
+				*b = j;
+			}
+		}
+	}
+	return best;
+}
+
+/**
+ * Every render pass scissors once per damage rect, so a fragmented damage
+ * region multiplies the draw calls. Merge the rects into at most
+ * debug.damage_rects boxes, and merge further where drawing the gap between two
+ * boxes is cheaper than a pass. The result covers the original damage.
+ */
+static void simplify_damage(pixman_region32_t *damage) {
+	int max_rects = debug.damage_rects ?
+		debug.damage_rects : DAMAGE_RECTS_DEFAULT;
+	int64_t pass_cost = debug.damage_pass_cost ?
+		debug.damage_pass_cost : DAMAGE_PASS_COST_DEFAULT;
+	if (max_rects < 0) {
+		return;
+	}
+
+	int nrects;
+	pixman_box32_t *rects = pixman_region32_rectangles(damage, &nrects);
+	if (nrects <= 1) {
+		return;
+	}
+
+	// Rects are sorted in bands from top to bottom, so if there are too many
+	// to look at, runs of neighbouring rects are folded together first
+	pixman_box32_t boxes[DAMAGE_BOXES_MAX];
+	int per_box = (nrects + DAMAGE_BOXES_MAX - 1) / DAMAGE_BOXES_MAX;
+	int n = 0;
+	for (int i = 0; i < nrects; ++i) {
+		if (i % per_box == 0) {
+			boxes[n++] = rects[i];
+		} else {
+			box_union(&boxes[n - 1], &boxes[n - 1], &rects[i]);
+		}
+	}
+	if (per_box > 1) {
+		for (int i = 0; i < n; ++i) {
+			int prev = n;
+			n = damage_boxes_absorb(boxes, n, i);
+			if (n != prev) {
+				i = -1;
+			}
+		}
+	}
+
+	int target = max_rects;
+	while (true) {
+		while (n > 1) {
+			int a = 0, b = 1;
+			int64_t cost = damage_boxes_cheapest_pair(boxes, n, pass_cost,
+				&a, &b);
+			if (n <= target && cost >= 0) {
+				break;
+			}
+			box_union(&boxes[a], &boxes[a], &boxes[b]);
+			boxes[b] = boxes[--n];
+			n = damage_boxes_absorb(boxes, n, a);
+		}
+
+		pixman_region32_clear(damage);
+		for (int i = 0; i < n; ++i) {
+			pixman_region32_union_rect(damage, damage,
+				boxes[i].x1, boxes[i].y1,
+				boxes[i].x2 - boxes[i].x1, boxes[i].y2 - boxes[i].y1);
+		}
+		// The region splits the boxes into bands, which can take more rects
+		if (n == 1 || pixman_region32_n_rects(damage) <= target) {
+			break;
+		}
+		target = n - 1;
+	}
+}
+
 static void render_seatops(struct sway_output *output,
 		pixman_region32_t *damage) {
 	struct sway_seat *seat;
@@ -977,7 +1521,10 @@ void output_render(struct sway_output *output, struct timespec *when,
 		return;
 	}
 
+	uint64_t trace_start = trace_begin();
+
 	wlr_renderer_begin(renderer, wlr_output->width, wlr_output->height);
+	rect_batch_begin(output, damage);
 
 	if (!pixman_region32_not_empty(damage)) {
 		// Output isn't damaged but needs buffer swap
@@ -992,6 +1539,8 @@ void output_render(struct sway_output *output, struct timespec *when,
 		pixman_region32_union_rect(damage, damage, 0, 0, width, height);
 	}
 
+	simplify_damage(damage);
+
 	if (output_has_opaque_overlay_layer_surface(output)) {
 		goto render_overlay;
 	}
@@ -1071,10 +1620,14 @@ render_overlay:
 	render_drag_icons(output, damage, &root->drag_icons);
 
 renderer_end:
+	rect_batch_end();
 	wlr_renderer_scissor(renderer, NULL);
 	wlr_output_render_software_cursors(wlr_output, damage);
 	wlr_renderer_end(renderer);
 
+	trace_end(TRACE_OUTPUT_RENDER, trace_start,
+			pixman_region32_n_rects(damage));
+
 	int width, height;
 	wlr_output_transformed_resolution(wlr_output, &width, &height);
 
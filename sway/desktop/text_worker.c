@@ -0,0 +1,484 @@
+#define _POSIX_C_SOURCE 200809L
+#include <cairo/cairo.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/backend.h>
+#include <wlr/render/wlr_renderer.h>
+#include "cairo.h"
+#include "pango.h"
+#include "sway/desktop/text_worker.h"
+#include "sway/server.h"
+#include "log.h"
+
+#define TEXT_WORKER_MAX_THREADS 4
+#define TEXT_TEXTURE_POOL_SIZE 16
+
+struct text_job {
+	struct wl_list link; // text_worker::queue or text_worker::done
+	struct wl_list pending_link; // text_worker::pending
+	bool queued; // protected by text_worker::lock
+	bool canceled;
+
+	struct wlr_texture **texture;
+	void (*done)(void *data);
+	void *data;
+
+	// The font and text are owned by the job
+	struct text_texture_request request;
+
+	// Set instead of the request for a canvas
+	int width, height;
+	struct text_canvas_op *ops;
+	int ops_length;
+
+	cairo_surface_t *surface;
+};
+
+static struct {
+	pthread_t threads[TEXT_WORKER_MAX_THREADS];
+	int nthreads;
+	int eventfd;
+	struct wl_event_source *event_source;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool stopping;
+	struct wl_list queue; // text_job::link, new jobs are inserted at the head
+	struct wl_list done; // text_job::link
+
+	// Jobs which haven't been finished on the main thread yet, only accessed
+	// from the main thread
+	struct wl_list pending; // text_job::pending_link
+
+	// Released textures, reused for text which renders to the same size
+	// instead of allocating a new texture. Only accessed from the main thread.
+	struct wlr_texture *texture_pool[TEXT_TEXTURE_POOL_SIZE];
+	int texture_pool_length;
+} worker = {
+	.eventfd = -1,
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void copy_text_request(struct text_texture_request *dest,
+		const struct text_texture_request *src) {
+	*dest = *src;
+	dest->font = strdup(src->font);
+	dest->text = strdup(src->text);
+}
+
+static void finish_text_request(struct text_texture_request *request) {
+	free((char *)request->font);
+	free((char *)request->text);
+}
+
+static void text_job_destroy(struct text_job *job) {
+	if (job->surface) {
+		cairo_surface_destroy(job->surface);
+	}
+	if (job->ops) {
+		for (int i = 0; i < job->ops_length; ++i) {
+			if (job->ops[i].type == TEXT_CANVAS_TEXT) {
+				finish_text_request(&job->ops[i].text);
+			}
+		}
+		free(job->ops);
+	} else {
+		finish_text_request(&job->request);
+	}
+	free(job);
+}
+
+static cairo_font_options_t *create_font_options(
+		const struct text_texture_request *request) {
+	if (!request->subpixel_aa) {
+		return NULL;
+	}
+	cairo_font_options_t *fo = cairo_font_options_create();
+	cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
+	cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
+	cairo_font_options_set_subpixel_order(fo,
+			to_cairo_subpixel_order(request->subpixel));
+	return fo;
+}
+
+/**
+ * Draw the text on its background at the current origin, filling the current
+ * clip with the background.
+ */
+static void draw_text(cairo_t *cairo,
+		const struct text_texture_request *request) {
+	cairo_font_options_t *fo = create_font_options(request);
+	if (fo) {
+		cairo_set_font_options(cairo, fo);
+		cairo_font_options_destroy(fo);
+	}
+	cairo_set_source_rgba(cairo, request->background[0],
+			request->background[1], request->background[2],
+			request->background[3]);
+	cairo_paint(cairo);
+	cairo_set_source_rgba(cairo, request->foreground[0],
+			request->foreground[1], request->foreground[2],
+			request->foreground[3]);
+	cairo_move_to(cairo, 0, 0);
+
+	pango_printf(cairo, request->font, request->scale, request->markup,
+			"%s", request->text);
+}
+
+static void text_job_rasterize(struct text_job *job) {
+	struct text_texture_request *request = &job->request;
+	int width = 0;
+	cairo_font_options_t *fo = create_font_options(request);
+	if (fo) {
+		// We must use a non-nil cairo_t for cairo_set_font_options to work.
+		// Therefore, we cannot use cairo_create(NULL).
+		cairo_surface_t *dummy_surface = cairo_image_surface_create(
+				CAIRO_FORMAT_ARGB32, 0, 0);
+		cairo_t *c = cairo_create(dummy_surface);
+		cairo_set_antialias(c, CAIRO_ANTIALIAS_BEST);
+		cairo_set_font_options(c, fo);
+		get_text_size(c, request->font, &width, NULL, NULL, request->scale,
+				request->markup, "%s", request->text);
+		cairo_surface_destroy(dummy_surface);
+		cairo_destroy(c);
+		cairo_font_options_destroy(fo);
+	} else {
+		cairo_t *c = cairo_create(NULL);
+		get_text_size(c, request->font, &width, NULL, NULL, request->scale,
+				request->markup, "%s", request->text);
+		cairo_destroy(c);
+	}
+
+	cairo_surface_t *surface = cairo_image_surface_create(
+			CAIRO_FORMAT_ARGB32, width, request->height);
+	cairo_t *cairo = cairo_create(surface);
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+	draw_text(cairo, request);
+	cairo_surface_flush(surface);
+	cairo_destroy(cairo);
+	job->surface = surface;
+}
+
+static void text_job_rasterize_canvas(struct text_job *job) {
+	cairo_surface_t *surface = cairo_image_surface_create(
+			CAIRO_FORMAT_ARGB32, job->width, job->height);
+	cairo_t *cairo = cairo_create(surface);
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+	for (int i = 0; i < job->ops_length; ++i) {
+		struct text_canvas_op *op = &job->ops[i];
+		cairo_save(cairo);
+		cairo_rectangle(cairo, op->box.x, op->box.y,
+				op->box.width, op->box.height);
+		cairo_clip(cairo);
+		if (op->type == TEXT_CANVAS_RECT) {
+			cairo_set_source_rgba(cairo, op->color[0], op->color[1],
+					op->color[2], op->color[3]);
+			cairo_paint(cairo);
+		} else {
+			cairo_translate(cairo, op->box.x, op->box.y);
+			draw_text(cairo, &op->text);
+		}
+		cairo_restore(cairo);
+	}
+	cairo_surface_flush(surface);
+	cairo_destroy(cairo);
+	job->surface = surface;
+}
+
+static bool texture_has_size(struct wlr_texture *texture,
+		int width, int height) {
+	int texture_width, texture_height;
+	wlr_texture_get_size(texture, &texture_width, &texture_height);
+	return texture_width == width && texture_height == height;
+}
+
+void text_worker_release_texture(struct wlr_texture *texture) {
+	if (!texture) {
+		return;
+	}
+	if (worker.stopping) {
+		wlr_texture_destroy(texture);
+		return;
+	}
+	if (worker.texture_pool_length == TEXT_TEXTURE_POOL_SIZE) {
+		// Evict the oldest
+		wlr_texture_destroy(worker.texture_pool[0]);
+		memmove(&worker.texture_pool[0], &worker.texture_pool[1],
+				sizeof(struct wlr_texture *) * --worker.texture_pool_length);
+	}
+	worker.texture_pool[worker.texture_pool_length++] = texture;
+}
+
+static struct wlr_texture *texture_pool_take(int width, int height) {
+	for (int i = worker.texture_pool_length - 1; i >= 0; --i) {
+		struct wlr_texture *texture = worker.texture_pool[i];
+		if (texture_has_size(texture, width, height)) {
+			memmove(&worker.texture_pool[i], &worker.texture_pool[i + 1],
+					sizeof(struct wlr_texture *) *
+					(--worker.texture_pool_length - i));
+			return texture;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Upload the job's pixels and swap them in, on the main thread. Titles which
+ * change often, like clocks or progress counters, usually keep their size, so
+ * the pixels are written into the existing texture or a pooled one of the same
+ * size when possible rather than allocating a new texture.
+ */
+static void text_job_finish(struct text_job *job) {
+	wl_list_remove(&job->pending_link);
+	if (job->canceled) {
+		text_job_destroy(job);
+		return;
+	}
+
+	int width = cairo_image_surface_get_width(job->surface);
+	int height = cairo_image_surface_get_height(job->surface);
+	int stride = cairo_image_surface_get_stride(job->surface);
+	unsigned char *data = cairo_image_surface_get_data(job->surface);
+	struct wlr_texture *texture = NULL;
+	if (width > 0 && height > 0) {
+		if (*job->texture && texture_has_size(*job->texture, width, height)) {
+			texture = *job->texture;
+		} else {
+			texture = texture_pool_take(width, height);
+		}
+		if (texture && !wlr_texture_write_pixels(texture, stride,
+					width, height, 0, 0, 0, 0, data)) {
+			if (texture != *job->texture) {
+				wlr_texture_destroy(texture);
+			}
+			texture = NULL;
+		}
+		if (!texture) {
+			struct wlr_renderer *renderer =
+				wlr_backend_get_renderer(server.backend);
+			texture = wlr_texture_from_pixels(renderer,
+					WL_SHM_FORMAT_ARGB8888, stride, width, height, data);
+		}
+	}
+	if (*job->texture != texture) {
+		text_worker_release_texture(*job->texture);
+		*job->texture = texture;
+	}
+	if (job->done) {
+		job->done(job->data);
+	}
+	text_job_destroy(job);
+}
+
+static void *worker_run(void *data) {
+	pthread_mutex_lock(&worker.lock);
+	while (true) {
+		while (!worker.stopping && wl_list_empty(&worker.queue)) {
+			pthread_cond_wait(&worker.cond, &worker.lock);
+		}
+		if (worker.stopping) {
+			break;
+		}
+		struct text_job *job = wl_container_of(worker.queue.prev, job, link);
+		wl_list_remove(&job->link);
+		job->queued = false;
+		pthread_mutex_unlock(&worker.lock);
+
+		if (job->ops) {
+			text_job_rasterize_canvas(job);
+		} else {
+			text_job_rasterize(job);
+		}
+
+		pthread_mutex_lock(&worker.lock);
+		wl_list_insert(worker.done.prev, &job->link);
+		uint64_t one = 1;
+		if (write(worker.eventfd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+			sway_log_errno(SWAY_ERROR, "Unable to signal text worker");
+		}
+	}
+	pthread_mutex_unlock(&worker.lock);
+	text_cache_fini();
+	return NULL;
+}
+
+static int handle_jobs_done(int fd, uint32_t mask, void *data) {
+	uint64_t count;
+	if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+		sway_log_errno(SWAY_ERROR, "Unable to read text worker eventfd");
+	}
+
+	struct wl_list done;
+	wl_list_init(&done);
+	pthread_mutex_lock(&worker.lock);
+	wl_list_insert_list(&done, &worker.done);
+	wl_list_init(&worker.done);
+	pthread_mutex_unlock(&worker.lock);
+
+	struct text_job *job, *tmp;
+	wl_list_for_each_safe(job, tmp, &done, link) {
+		wl_list_remove(&job->link);
+		text_job_finish(job);
+	}
+	return 0;
+}
+
+void text_worker_init(void) {
+	wl_list_init(&worker.queue);
+	wl_list_init(&worker.done);
+	wl_list_init(&worker.pending);
+
+	worker.eventfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (worker.eventfd < 0) {
+		sway_log_errno(SWAY_ERROR, "Unable to create text worker eventfd, "
+				"text will be rendered on the main thread");
+		return;
+	}
+	worker.event_source = wl_event_loop_add_fd(server.wl_event_loop,
+			worker.eventfd, WL_EVENT_READABLE, handle_jobs_done, NULL);
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int nthreads = ncpus > 1 ? ncpus - 1 : 1;
+	if (nthreads > TEXT_WORKER_MAX_THREADS) {
+		nthreads = TEXT_WORKER_MAX_THREADS;
+	}
+	for (int i = 0; i < nthreads; ++i) {
+		if (pthread_create(&worker.threads[i], NULL, worker_run, NULL) != 0) {
+			sway_log(SWAY_ERROR, "Unable to start text worker thread");
+			break;
+		}
+		worker.nthreads++;
+	}
+	sway_log(SWAY_DEBUG, "Started %d text worker threads", worker.nthreads);
+}
+
+void text_worker_fini(void) {
+	pthread_mutex_lock(&worker.lock);
+	worker.stopping = true;
+	pthread_cond_broadcast(&worker.cond);
+	pthread_mutex_unlock(&worker.lock);
+	for (int i = 0; i < worker.nthreads; ++i) {
+		pthread_join(worker.threads[i], NULL);
+	}
+	worker.nthreads = 0;
+
+	struct text_job *job, *tmp;
+	wl_list_for_each_safe(job, tmp, &worker.pending, pending_link) {
+		wl_list_remove(&job->pending_link);
+		wl_list_remove(&job->link);
+		text_job_destroy(job);
+	}
+	if (worker.event_source) {
+		wl_event_source_remove(worker.event_source);
+		worker.event_source = NULL;
+	}
+	if (worker.eventfd >= 0) {
+		close(worker.eventfd);
+		worker.eventfd = -1;
+	}
+	for (int i = 0; i < worker.texture_pool_length; ++i) {
+		wlr_texture_destroy(worker.texture_pool[i]);
+	}
+	worker.texture_pool_length = 0;
+}
+
+static struct text_job *text_job_create(struct wlr_texture **texture,
+		void (*done)(void *data), void *data) {
+	text_worker_cancel(texture);
+
+	struct text_job *job = calloc(1, sizeof(struct text_job));
+	if (!job) {
+		sway_log(SWAY_ERROR, "Unable to allocate text job");
+		return NULL;
+	}
+	job->texture = texture;
+	job->done = done;
+	job->data = data;
+	return job;
+}
+
+static void text_job_submit(struct text_job *job) {
+	wl_list_insert(&worker.pending, &job->pending_link);
+
+	if (worker.nthreads == 0) {
+		if (job->ops) {
+			text_job_rasterize_canvas(job);
+		} else {
+			text_job_rasterize(job);
+		}
+		text_job_finish(job);
+		return;
+	}
+
+	pthread_mutex_lock(&worker.lock);
+	job->queued = true;
+	wl_list_insert(&worker.queue, &job->link);
+	pthread_cond_signal(&worker.cond);
+	pthread_mutex_unlock(&worker.lock);
+}
+
+void text_worker_update_texture(struct wlr_texture **texture,
+		const struct text_texture_request *request,
+		void (*done)(void *data), void *data) {
+	struct text_job *job = text_job_create(texture, done, data);
+	if (!job) {
+		return;
+	}
+	copy_text_request(&job->request, request);
+	text_job_submit(job);
+}
+
+void text_worker_update_canvas(struct wlr_texture **texture,
+		int width, int height, const struct text_canvas_op *ops,
+		int ops_length, void (*done)(void *data), void *data) {
+	struct text_job *job = text_job_create(texture, done, data);
+	if (!job) {
+		return;
+	}
+	job->ops = calloc(ops_length ? ops_length : 1,
+			sizeof(struct text_canvas_op));
+	if (!job->ops) {
+		sway_log(SWAY_ERROR, "Unable to allocate text job");
+		free(job);
+		return;
+	}
+	job->width = width;
+	job->height = height;
+	job->ops_length = ops_length;
+	for (int i = 0; i < ops_length; ++i) {
+		job->ops[i] = ops[i];
+		if (ops[i].type == TEXT_CANVAS_TEXT) {
+			copy_text_request(&job->ops[i].text, &ops[i].text);
+		}
+	}
+	text_job_submit(job);
+}
+
+void text_worker_cancel(struct wlr_texture **texture) {
+	struct text_job *job, *tmp;
+	wl_list_for_each_safe(job, tmp, &worker.pending, pending_link) {
+		if (job->texture != texture || job->canceled) {
+			continue;
+		}
+		pthread_mutex_lock(&worker.lock);
+		bool queued = job->queued;
+		if (queued) {
+			// Not picked up by a worker yet, so it can be dropped right away
+			wl_list_remove(&job->link);
+		}
+		pthread_mutex_unlock(&worker.lock);
+
+		if (queued) {
+			wl_list_remove(&job->pending_link);
+			text_job_destroy(job);
+		} else {
+			job->canceled = true;
+		}
+	}
+}
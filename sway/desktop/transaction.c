@@ -11,6 +11,7 @@
 #include "sway/input/cursor.h"
 #include "sway/input/input-manager.h"
 #include "sway/output.h"
+#include "sway/trace.h"
 #include "sway/tree/container.h"
 #include "sway/tree/node.h"
 #include "sway/tree/view.h"
@@ -18,6 +19,12 @@
 #include "list.h"
 #include "log.h"
 
+// Instructions are recycled rather than allocated for every node of every
+// transaction. This caps how many are kept around between transactions.
+#define INSTRUCTION_POOL_MAX 1024
+
+static list_t *instruction_pool = NULL; // struct sway_transaction_instruction *
+
 struct sway_transaction {
 	struct wl_event_source *timer;
 	list_t *instructions;   // struct sway_transaction_instruction *
@@ -47,12 +54,63 @@ static struct sway_transaction *transaction_create(void) {
 	return transaction;
 }
 
+static struct sway_transaction_instruction *instruction_create(void) {
+	if (instruction_pool && instruction_pool->length) {
+		struct sway_transaction_instruction *instruction =
+			instruction_pool->items[instruction_pool->length - 1];
+		list_del(instruction_pool, instruction_pool->length - 1);
+		memset(instruction, 0, sizeof(struct sway_transaction_instruction));
+		return instruction;
+	}
+	return calloc(1, sizeof(struct sway_transaction_instruction));
+}
+
+static void instruction_destroy(
+		struct sway_transaction_instruction *instruction) {
+	if (!instruction_pool) {
+		instruction_pool = create_list();
+	}
+	if (instruction_pool->length < INSTRUCTION_POOL_MAX) {
+		list_add(instruction_pool, instruction);
+	} else {
+		free(instruction);
+	}
+}
+
+void transaction_pool_fini(void) {
+	if (!instruction_pool) {
+		return;
+	}
+	list_free_items_and_destroy(instruction_pool);
+	instruction_pool = NULL;
+}
+
+// Drop the instruction's references to its list snapshots
+static void instruction_release_state(
+		struct sway_transaction_instruction *instruction) {
+	switch (instruction->node->type) {
+	case N_ROOT:
+		break;
+	case N_OUTPUT:
+		list_snapshot_unref(instruction->output_state.workspaces);
+		break;
+	case N_WORKSPACE:
+		list_snapshot_unref(instruction->workspace_state.floating);
+		list_snapshot_unref(instruction->workspace_state.tiling);
+		break;
+	case N_CONTAINER:
+		list_snapshot_unref(instruction->container_state.children);
+		break;
+	}
+}
+
 static void transaction_destroy(struct sway_transaction *transaction) {
 	// Free instructions
 	for (int i = 0; i < transaction->instructions->length; ++i) {
 		struct sway_transaction_instruction *instruction =
 			transaction->instructions->items[i];
 		struct sway_node *node = instruction->node;
+		instruction_release_state(instruction);
 		node->ntxnrefs--;
 		if (node->instruction == instruction) {
 			node->instruction = NULL;
@@ -73,7 +131,7 @@ static void transaction_destroy(struct sway_transaction *transaction) {
 				break;
 			}
 		}
-		free(instruction);
+		instruction_destroy(instruction);
 	}
 	list_free(transaction->instructions);
 
@@ -83,11 +141,24 @@ static void transaction_destroy(struct sway_transaction *transaction) {
 	free(transaction);
 }
 
+/**
+ * Returns a reference to a snapshot of the pending list. The previous snapshot
+ * is reused if the list hasn't changed since it was taken, so unchanged nodes
+ * share a single copy between all instructions and their current state.
+ */
+static list_t *snapshot_list(list_t *pending, list_t **snapshot) {
+	if (!*snapshot || !list_items_equal(*snapshot, pending)) {
+		list_snapshot_unref(*snapshot);
+		*snapshot = create_list_snapshot(pending);
+	}
+	return list_snapshot_ref(*snapshot);
+}
+
 static void copy_output_state(struct sway_output *output,
 		struct sway_transaction_instruction *instruction) {
 	struct sway_output_state *state = &instruction->output_state;
-	state->workspaces = create_list();
-	list_cat(state->workspaces, output->workspaces);
+	state->workspaces =
+		snapshot_list(output->workspaces, &output->workspaces_snapshot);
 
 	state->active_workspace = output_get_active_workspace(output);
 }
@@ -104,10 +175,8 @@ static void copy_workspace_state(struct sway_workspace *ws,
 	state->layout = ws->layout;
 
 	state->output = ws->output;
-	state->floating = create_list();
-	state->tiling = create_list();
-	list_cat(state->floating, ws->floating);
-	list_cat(state->tiling, ws->tiling);
+	state->floating = snapshot_list(ws->floating, &ws->floating_snapshot);
+	state->tiling = snapshot_list(ws->tiling, &ws->tiling_snapshot);
 
 	struct sway_seat *seat = input_manager_current_seat();
 	state->focused = seat_get_focus(seat) == &ws->node;
@@ -146,8 +215,8 @@ static void copy_container_state(struct sway_container *container,
 	state->content_height = container->content_height;
 
 	if (!container->view) {
-		state->children = create_list();
-		list_cat(state->children, container->children);
+		state->children = snapshot_list(container->children,
+				&container->children_snapshot);
 	}
 
 	struct sway_seat *seat = input_manager_current_seat();
@@ -162,8 +231,7 @@ static void copy_container_state(struct sway_container *container,
 
 static void transaction_add_node(struct sway_transaction *transaction,
 		struct sway_node *node) {
-	struct sway_transaction_instruction *instruction =
-		calloc(1, sizeof(struct sway_transaction_instruction));
+	struct sway_transaction_instruction *instruction = instruction_create();
 	if (!sway_assert(instruction, "Unable to allocate instruction")) {
 		return;
 	}
@@ -191,17 +259,20 @@ static void transaction_add_node(struct sway_transaction *transaction,
 static void apply_output_state(struct sway_output *output,
 		struct sway_output_state *state) {
 	output_damage_whole(output);
-	list_free(output->current.workspaces);
+	list_snapshot_unref(output->current.workspaces);
 	memcpy(&output->current, state, sizeof(struct sway_output_state));
+	list_snapshot_ref(output->current.workspaces);
 	output_damage_whole(output);
 }
 
 static void apply_workspace_state(struct sway_workspace *ws,
 		struct sway_workspace_state *state) {
 	output_damage_whole(ws->current.output);
-	list_free(ws->current.floating);
-	list_free(ws->current.tiling);
+	list_snapshot_unref(ws->current.floating);
+	list_snapshot_unref(ws->current.tiling);
 	memcpy(&ws->current, state, sizeof(struct sway_workspace_state));
+	list_snapshot_ref(ws->current.floating);
+	list_snapshot_ref(ws->current.tiling);
 	output_damage_whole(ws->current.output);
 }
 
@@ -220,14 +291,16 @@ static void apply_container_state(struct sway_container *container,
 		desktop_damage_box(&box);
 	}
 
-	// There are separate children lists for each instruction state, the
-	// container's current state and the container's pending state
-	// (ie. con->children). The list itself needs to be freed here.
+	// The children list snapshots are shared between instruction states and
+	// the container's current state, and are separate from the container's
+	// pending state (ie. con->children). The current state holds its own
+	// reference, the instruction's is dropped in transaction_destroy().
 	// Any child containers which are being deleted will be cleaned up in
 	// transaction_destroy().
-	list_free(container->current.children);
+	list_snapshot_unref(container->current.children);
 
 	memcpy(&container->current, state, sizeof(struct sway_container_state));
+	list_snapshot_ref(container->current.children);
 
 	if (view && view->saved_buffer) {
 		if (!container->node.destroying || container->node.ntxnrefs == 1) {
@@ -278,6 +351,7 @@ static void apply_container_state(struct sway_container *container,
  */
 static void transaction_apply(struct sway_transaction *transaction) {
 	sway_log(SWAY_DEBUG, "Applying transaction %p", transaction);
+	uint64_t trace_start = trace_begin();
 	if (debug.txn_timings) {
 		struct timespec now;
 		clock_gettime(CLOCK_MONOTONIC, &now);
@@ -314,6 +388,8 @@ static void transaction_apply(struct sway_transaction *transaction) {
 	}
 
 	cursor_rebase_all();
+	trace_end(TRACE_TRANSACTION_APPLY, trace_start,
+			transaction->instructions->length);
 }
 
 static void transaction_commit(struct sway_transaction *transaction);
@@ -410,6 +486,7 @@ static bool should_configure(struct sway_node *node,
 static void transaction_commit(struct sway_transaction *transaction) {
 	sway_log(SWAY_DEBUG, "Transaction %p committing with %i instructions",
 			transaction, transaction->instructions->length);
+	uint64_t trace_start = trace_begin();
 	transaction->num_waiting = 0;
 	for (int i = 0; i < transaction->instructions->length; ++i) {
 		struct sway_transaction_instruction *instruction =
@@ -465,6 +542,8 @@ static void transaction_commit(struct sway_transaction *transaction) {
 			transaction->num_waiting = 0;
 		}
 	}
+	trace_end(TRACE_TRANSACTION_COMMIT, trace_start,
+			transaction->instructions->length);
 }
 
 static void set_instruction_ready(
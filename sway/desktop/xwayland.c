@@ -655,6 +655,13 @@ void handle_xwayland_ready(struct wl_listener *listener, void *data) {
 		wl_container_of(listener, server, xwayland_ready);
 	struct sway_xwayland *xwayland = &server->xwayland;
 
+	if (!xwayland->ready) {
+		xwayland->ready = true;
+		if (!xwayland->xcursor_manager) {
+			seat_configure_xcursor(input_manager_get_default_seat());
+		}
+	}
+
 	xcb_connection_t *xcb_conn = xcb_connect(NULL, NULL);
 	int err = xcb_connection_has_error(xcb_conn);
 	if (err) {
@@ -22,6 +22,7 @@
 #include "sway/input/keyboard.h"
 #include "sway/layers.h"
 #include "sway/output.h"
+#include "sway/trace.h"
 #include "sway/tree/arrange.h"
 #include "sway/tree/container.h"
 #include "sway/tree/root.h"
@@ -57,7 +58,7 @@ static struct wlr_surface *layer_surface_at(struct sway_output *output,
  * Returns the node at the cursor's position. If there is a surface at that
  * location, it is stored in **surface (it may not be a view).
  */
-struct sway_node *node_at_coords(
+static struct sway_node *find_node_at_coords(
 		struct sway_seat *seat, double lx, double ly,
 		struct wlr_surface **surface, double *sx, double *sy) {
 	// check for unmanaged views first
@@ -158,6 +159,16 @@ struct sway_node *node_at_coords(
 	return &ws->node;
 }
 
+struct sway_node *node_at_coords(
+		struct sway_seat *seat, double lx, double ly,
+		struct wlr_surface **surface, double *sx, double *sy) {
+	uint64_t trace_start = trace_begin();
+	struct sway_node *node =
+		find_node_at_coords(seat, lx, ly, surface, sx, sy);
+	trace_end(TRACE_NODE_AT_COORDS, trace_start, 0);
+	return node;
+}
+
 void cursor_rebase(struct sway_cursor *cursor) {
 	uint32_t time_msec = get_current_time_msec();
 	seatop_rebase(cursor->seat, time_msec);
@@ -64,6 +64,127 @@ static void seat_node_destroy(struct sway_seat_node *seat_node) {
 	wl_list_remove(&seat_node->destroy.link);
 	wl_list_remove(&seat_node->link);
 	free(seat_node);
+	seat_invalidate_focus_cache();
+}
+
+/**
+ * The focus-inactive queries are made for most nodes by get_tree, arrange and
+ * focus changes. Instead of walking the focus stack and checking ancestry for
+ * each query, the results for all nodes are computed in a single pass over the
+ * focus stack and cached on the nodes until the next focus stack or tree
+ * structure change.
+ */
+static uint64_t focus_cache_epoch = 1;
+static uint64_t focus_cache_last_tag = 0;
+
+void seat_invalidate_focus_cache(void) {
+	++focus_cache_epoch;
+}
+
+static void focus_cache_touch(struct sway_node *node, uint64_t tag) {
+	if (node->focus_cache.tag != tag) {
+		memset(&node->focus_cache, 0, sizeof(node->focus_cache));
+		node->focus_cache.tag = tag;
+	}
+}
+
+static bool node_is_fullscreen_global(struct sway_node *node) {
+	return node->type == N_CONTAINER &&
+		node->sway_container->fullscreen_mode == FULLSCREEN_GLOBAL;
+}
+
+/**
+ * Record node as the focus-inactive (or focus-inactive view) of each of its
+ * ancestors which don't have one yet. When an ancestor already has one, a node
+ * earlier in the focus stack has walked the rest of the chain, so stop there.
+ * This mirrors node_has_ancestor, including its global fullscreen special case.
+ */
+static void focus_cache_propagate(struct sway_node *node, uint64_t tag,
+		bool view) {
+	bool fullscreen_global = node_is_fullscreen_global(node);
+	struct sway_node *parent = node_get_parent(node);
+	while (parent) {
+		focus_cache_touch(parent, tag);
+		struct sway_node **slot = view ?
+			&parent->focus_cache.focus_inactive_view :
+			&parent->focus_cache.focus_inactive;
+		if (*slot) {
+			break;
+		}
+		*slot = node;
+		fullscreen_global |= node_is_fullscreen_global(parent);
+		parent = node_get_parent(parent);
+	}
+	if (fullscreen_global) {
+		focus_cache_touch(&root->node, tag);
+		struct sway_node **slot = view ?
+			&root->node.focus_cache.focus_inactive_view :
+			&root->node.focus_cache.focus_inactive;
+		if (!*slot) {
+			*slot = node;
+		}
+	}
+}
+
+static void focus_cache_update(struct sway_seat *seat) {
+	// The cache lives on the nodes, so it only holds the results of the seat
+	// which rebuilt it last. Every rebuild gets a unique tag so entries left
+	// behind by earlier rebuilds never appear valid. Nodes not touched below
+	// have no focus-inactive descendants and end up with empty results.
+	if (seat->focus_cache_epoch == focus_cache_epoch &&
+			seat->focus_cache_tag == focus_cache_last_tag) {
+		return;
+	}
+	uint64_t tag = ++focus_cache_last_tag;
+	seat->focus_cache_epoch = focus_cache_epoch;
+	seat->focus_cache_tag = tag;
+
+	struct sway_seat_node *current;
+	wl_list_for_each(current, &seat->focus_stack, link) {
+		struct sway_node *node = current->node;
+		focus_cache_propagate(node, tag, false);
+		if (node_is_view(node)) {
+			focus_cache_propagate(node, tag, true);
+		}
+
+		struct sway_node *parent = node_get_parent(node);
+		if (parent) {
+			focus_cache_touch(parent, tag);
+			if (!parent->focus_cache.active_tiling_child &&
+					(parent->type != N_WORKSPACE ||
+					 list_find(parent->sway_workspace->tiling,
+						 node->sway_container) != -1)) {
+				parent->focus_cache.active_tiling_child = node;
+			}
+		}
+
+		if (node->type != N_CONTAINER || !node->sway_container->workspace) {
+			continue;
+		}
+		struct sway_container *con = node->sway_container;
+		struct sway_node *ws_node = &con->workspace->node;
+		focus_cache_touch(ws_node, tag);
+		if (ws_node->focus_cache.focus_inactive_tiling &&
+				ws_node->focus_cache.focus_inactive_floating) {
+			continue;
+		}
+		struct sway_container **slot = container_is_floating_or_child(con) ?
+			&ws_node->focus_cache.focus_inactive_floating :
+			&ws_node->focus_cache.focus_inactive_tiling;
+		if (!*slot) {
+			*slot = con;
+		}
+	}
+}
+
+/**
+ * Return the cached focus stack query results for the node, or NULL if neither
+ * the node nor any of its descendants are in the seat's focus stack.
+ */
+static struct sway_node *focus_cache_get(struct sway_seat *seat,
+		struct sway_node *node) {
+	focus_cache_update(seat);
+	return node->focus_cache.tag == seat->focus_cache_tag ? node : NULL;
 }
 
 /**
@@ -133,13 +254,9 @@ struct sway_container *seat_get_focus_inactive_view(struct sway_seat *seat,
 	if (ancestor->type == N_CONTAINER && ancestor->sway_container->view) {
 		return ancestor->sway_container;
 	}
-	struct sway_seat_node *current;
-	wl_list_for_each(current, &seat->focus_stack, link) {
-		struct sway_node *node = current->node;
-		if (node->type == N_CONTAINER && node->sway_container->view &&
-				node_has_ancestor(node, ancestor)) {
-			return node->sway_container;
-		}
+	struct sway_node *cached = focus_cache_get(seat, ancestor);
+	if (cached && cached->focus_cache.focus_inactive_view) {
+		return cached->focus_cache.focus_inactive_view->sway_container;
 	}
 	return NULL;
 }
@@ -259,6 +376,7 @@ static struct sway_seat_node *seat_node_from_node(
 	wl_list_insert(seat->focus_stack.prev, &seat_node->link);
 	wl_signal_add(&node->events.destroy, &seat_node->destroy);
 	seat_node->destroy.notify = handle_seat_node_destroy;
+	seat_invalidate_focus_cache();
 
 	return seat_node;
 }
@@ -412,6 +530,7 @@ static void collect_focus_iter(struct sway_node *node, void *data) {
 	}
 	wl_list_remove(&seat_node->link);
 	wl_list_insert(&seat->focus_stack, &seat_node->link);
+	seat_invalidate_focus_cache();
 }
 
 static void collect_focus_workspace_iter(struct sway_workspace *workspace,
@@ -758,7 +877,12 @@ void seat_configure_xcursor(struct sway_seat *seat) {
 		}
 
 #if HAVE_XWAYLAND
-		if (config->xwayland && (!server.xwayland.xcursor_manager ||
+		// In lazy mode the X server isn't running yet, so loading its
+		// cursor theme is deferred until handle_xwayland_ready
+		bool xwayland_active =
+			config->xwayland == XWAYLAND_MODE_IMMEDIATE ||
+			(config->xwayland == XWAYLAND_MODE_LAZY && server.xwayland.ready);
+		if (xwayland_active && (!server.xwayland.xcursor_manager ||
 				!xcursor_manager_is_named(server.xwayland.xcursor_manager,
 					cursor_theme) ||
 				server.xwayland.xcursor_manager->size != cursor_size)) {
@@ -871,6 +995,7 @@ void seat_set_raw_focus(struct sway_seat *seat, struct sway_node *node) {
 	struct sway_seat_node *seat_node = seat_node_from_node(seat, node);
 	wl_list_remove(&seat_node->link);
 	wl_list_insert(&seat->focus_stack, &seat_node->link);
+	seat_invalidate_focus_cache();
 	node_set_dirty(node);
 
 	// If focusing a scratchpad container that is fullscreen global, parent
@@ -1124,11 +1249,9 @@ struct sway_node *seat_get_focus_inactive(struct sway_seat *seat,
 	if (node_is_view(node)) {
 		return node;
 	}
-	struct sway_seat_node *current;
-	wl_list_for_each(current, &seat->focus_stack, link) {
-		if (node_has_ancestor(current->node, node)) {
-			return current->node;
-		}
+	struct sway_node *cached = focus_cache_get(seat, node);
+	if (cached && cached->focus_cache.focus_inactive) {
+		return cached->focus_cache.focus_inactive;
 	}
 	if (node->type == N_WORKSPACE) {
 		return node;
@@ -1141,16 +1264,8 @@ struct sway_container *seat_get_focus_inactive_tiling(struct sway_seat *seat,
 	if (!workspace->tiling->length) {
 		return NULL;
 	}
-	struct sway_seat_node *current;
-	wl_list_for_each(current, &seat->focus_stack, link) {
-		struct sway_node *node = current->node;
-		if (node->type == N_CONTAINER &&
-				!container_is_floating_or_child(node->sway_container) &&
-				node->sway_container->workspace == workspace) {
-			return node->sway_container;
-		}
-	}
-	return NULL;
+	struct sway_node *cached = focus_cache_get(seat, &workspace->node);
+	return cached ? cached->focus_cache.focus_inactive_tiling : NULL;
 }
 
 struct sway_container *seat_get_focus_inactive_floating(struct sway_seat *seat,
@@ -1158,16 +1273,8 @@ struct sway_container *seat_get_focus_inactive_floating(struct sway_seat *seat,
 	if (!workspace->floating->length) {
 		return NULL;
 	}
-	struct sway_seat_node *current;
-	wl_list_for_each(current, &seat->focus_stack, link) {
-		struct sway_node *node = current->node;
-		if (node->type == N_CONTAINER &&
-				container_is_floating_or_child(node->sway_container) &&
-				node->sway_container->workspace == workspace) {
-			return node->sway_container;
-		}
-	}
-	return NULL;
+	struct sway_node *cached = focus_cache_get(seat, &workspace->node);
+	return cached ? cached->focus_cache.focus_inactive_floating : NULL;
 }
 
 struct sway_node *seat_get_active_tiling_child(struct sway_seat *seat,
@@ -1175,22 +1282,8 @@ struct sway_node *seat_get_active_tiling_child(struct sway_seat *seat,
 	if (node_is_view(parent)) {
 		return parent;
 	}
-	struct sway_seat_node *current;
-	wl_list_for_each(current, &seat->focus_stack, link) {
-		struct sway_node *node = current->node;
-		if (node_get_parent(node) != parent) {
-			continue;
-		}
-		if (parent->type == N_WORKSPACE) {
-			// Only consider tiling children
-			struct sway_workspace *ws = parent->sway_workspace;
-			if (list_find(ws->tiling, node->sway_container) == -1) {
-				continue;
-			}
-		}
-		return node;
-	}
-	return NULL;
+	struct sway_node *cached = focus_cache_get(seat, parent);
+	return cached ? cached->focus_cache.active_tiling_child : NULL;
 }
 
 struct sway_node *seat_get_focus(struct sway_seat *seat) {
@@ -22,6 +22,7 @@
 #include "sway/ipc-server.h"
 #include "sway/output.h"
 #include "sway/server.h"
+#include "sway/trace.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/keyboard.h"
 #include "sway/input/seat.h"
@@ -603,6 +604,8 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	}
 	buf[payload_length] = '\0';
 
+	uint64_t trace_start = trace_begin();
+
 	switch (payload_type) {
 	case IPC_COMMAND:
 	{
@@ -858,6 +861,23 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 		goto exit_cleanup;
 	}
 
+	case IPC_GET_TRACE:
+	{
+		if (!trace_enabled) {
+			const char *error = "{ \"success\": false, "
+				"\"error\": \"Tracing is not enabled\" }";
+			ipc_send_reply(client, payload_type, error,
+				(uint32_t)strlen(error));
+			goto exit_cleanup;
+		}
+		json_object *trace = trace_get_json();
+		const char *json_string = json_object_to_json_string(trace);
+		ipc_send_reply(client, payload_type, json_string,
+			(uint32_t)strlen(json_string));
+		json_object_put(trace);
+		goto exit_cleanup;
+	}
+
 	case IPC_SYNC:
 	{
 		// It was decided sway will not support this, just return success:false
@@ -872,6 +892,7 @@ void ipc_client_handle_command(struct ipc_client *client, uint32_t payload_lengt
 	}
 
 exit_cleanup:
+	trace_end(TRACE_IPC_MESSAGE, trace_start, payload_type);
 	free(buf);
 	return;
 }
@@ -19,8 +19,10 @@
 #include "sway/desktop/transaction.h"
 #include "sway/tree/root.h"
 #include "sway/ipc-server.h"
+#include "sway/trace.h"
 #include "ipc-client.h"
 #include "log.h"
+#include "pango.h"
 #include "stringop.h"
 #include "util.h"
 
@@ -198,11 +200,26 @@ static bool drop_permissions(void) {
 	return true;
 }
 
+static void handle_wlr_log(enum wlr_log_importance importance,
+		const char *fmt, va_list args) {
+	static const sway_log_importance_t importance_map[] = {
+		[WLR_SILENT] = SWAY_SILENT,
+		[WLR_ERROR] = SWAY_ERROR,
+		[WLR_INFO] = SWAY_INFO,
+		[WLR_DEBUG] = SWAY_DEBUG,
+	};
+	_sway_vlog(importance_map[importance], NULL, 0, fmt, args);
+}
+
 void enable_debug_flag(const char *flag) {
 	if (strcmp(flag, "damage=highlight") == 0) {
 		debug.damage = DAMAGE_HIGHLIGHT;
 	} else if (strcmp(flag, "damage=rerender") == 0) {
 		debug.damage = DAMAGE_RERENDER;
+	} else if (strncmp(flag, "damage-rects=", 13) == 0) {
+		debug.damage_rects = atoi(&flag[13]);
+	} else if (strncmp(flag, "damage-pass-cost=", 17) == 0) {
+		debug.damage_pass_cost = atoi(&flag[17]);
 	} else if (strcmp(flag, "noatomic") == 0) {
 		debug.noatomic = true;
 	} else if (strcmp(flag, "txn-wait") == 0) {
@@ -211,6 +228,17 @@ void enable_debug_flag(const char *flag) {
 		debug.txn_timings = true;
 	} else if (strncmp(flag, "txn-timeout=", 12) == 0) {
 		server.txn_timeout_ms = atoi(&flag[12]);
+	} else if (strcmp(flag, "trace") == 0) {
+		trace_init(16384);
+	} else if (strncmp(flag, "trace=", 6) == 0) {
+		char *end;
+		long records = strtol(&flag[6], &end, 10);
+		if (*end || records <= 0) {
+			sway_log(SWAY_ERROR, "Invalid number of trace records '%s'",
+					&flag[6]);
+		} else {
+			trace_init(records);
+		}
 	}
 }
 
@@ -301,17 +329,17 @@ int main(int argc, char **argv) {
 		exit(EXIT_FAILURE);
 	}
 
-	// As the 'callback' function for wlr_log is equivalent to that for
-	// sway, we do not need to override it.
+	// wlroots messages are routed through sway's logger so that they are
+	// ordered with sway's own messages once logging is asynchronous
 	if (debug) {
 		sway_log_init(SWAY_DEBUG, sway_terminate);
-		wlr_log_init(WLR_DEBUG, NULL);
+		wlr_log_init(WLR_DEBUG, handle_wlr_log);
 	} else if (verbose || validate) {
 		sway_log_init(SWAY_INFO, sway_terminate);
-		wlr_log_init(WLR_INFO, NULL);
+		wlr_log_init(WLR_INFO, handle_wlr_log);
 	} else {
 		sway_log_init(SWAY_ERROR, sway_terminate);
-		wlr_log_init(WLR_ERROR, NULL);
+		wlr_log_init(WLR_ERROR, handle_wlr_log);
 	}
 
 	log_kernel();
@@ -360,6 +388,11 @@ int main(int argc, char **argv) {
 	// prevent ipc from crashing sway
 	signal(SIGPIPE, SIG_IGN);
 
+	// keep writing log messages off the main loop
+	if (!sway_log_start_async()) {
+		sway_log(SWAY_ERROR, "Unable to start the log thread");
+	}
+
 	sway_log(SWAY_INFO, "Starting sway version " SWAY_VERSION);
 
 	root = root_create();
@@ -409,7 +442,10 @@ shutdown:
 	free(config_path);
 	free_config(config);
 
+	text_cache_fini();
 	pango_cairo_font_map_set_default(NULL);
 
+	trace_fini();
+
 	return exit_value;
 }
@@ -27,6 +27,8 @@
 #include "log.h"
 #include "sway/config.h"
 #include "sway/desktop/idle_inhibit_v1.h"
+#include "sway/desktop/text_worker.h"
+#include "sway/desktop/transaction.h"
 #include "sway/input/input-manager.h"
 #include "sway/output.h"
 #include "sway/server.h"
@@ -150,6 +152,8 @@ bool server_init(struct sway_server *server) {
 	server->dirty_nodes = create_list();
 	server->transactions = create_list();
 
+	text_worker_init();
+
 	server->input = input_manager_create(server);
 	input_manager_get_default_seat(); // create seat0
 
@@ -158,6 +162,7 @@ bool server_init(struct sway_server *server) {
 
 void server_fini(struct sway_server *server) {
 	// TODO: free sway-specific resources
+	text_worker_fini();
 #if HAVE_XWAYLAND
 	wlr_xwayland_destroy(server->xwayland.wlr_xwayland);
 #endif
@@ -165,14 +170,16 @@ void server_fini(struct sway_server *server) {
 	wl_display_destroy(server->wl_display);
 	list_free(server->dirty_nodes);
 	list_free(server->transactions);
+	transaction_pool_fini();
 }
 
 bool server_start(struct sway_server *server) {
 #if HAVE_XWAYLAND
-	if (config->xwayland) {
-		sway_log(SWAY_DEBUG, "Initializing Xwayland");
+	if (config->xwayland != XWAYLAND_MODE_DISABLED) {
+		bool lazy = config->xwayland == XWAYLAND_MODE_LAZY;
+		sway_log(SWAY_DEBUG, "Initializing Xwayland (lazy=%d)", lazy);
 		server->xwayland.wlr_xwayland =
-			wlr_xwayland_create(server->wl_display, server->compositor, true);
+			wlr_xwayland_create(server->wl_display, server->compositor, lazy);
 		wl_signal_add(&server->xwayland.wlr_xwayland->events.new_surface,
 			&server->xwayland_surface);
 		server->xwayland_surface.notify = handle_xwayland_surface;
@@ -182,7 +189,8 @@ bool server_start(struct sway_server *server) {
 
 		setenv("DISPLAY", server->xwayland.wlr_xwayland->display_name, true);
 
-		/* xcursor configured by the default seat */
+		/* xcursor configured by the default seat, or once the X server is
+		 * ready when it is started lazily */
 	}
 #endif
 
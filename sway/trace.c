@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 200809L
+#include <json.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "sway/trace.h"
+#include "log.h"
+
+bool trace_enabled = false;
+
+static struct sway_trace_record *records = NULL;
+static size_t records_mask = 0;
+static uint64_t records_written = 0;
+
+static const char *point_names[TRACE_POINT_LAST] = {
+	[TRACE_TRANSACTION_COMMIT] = "transaction_commit",
+	[TRACE_TRANSACTION_APPLY] = "transaction_apply",
+	[TRACE_OUTPUT_RENDER] = "output_render",
+	[TRACE_NODE_AT_COORDS] = "node_at_coords",
+	[TRACE_EXECUTE_COMMAND] = "execute_command",
+	[TRACE_IPC_MESSAGE] = "ipc_message",
+	[TRACE_VIEW_MAP] = "view_map",
+};
+
+// Name of the integer argument attached to each span, if any
+static const char *point_arg_names[TRACE_POINT_LAST] = {
+	[TRACE_TRANSACTION_COMMIT] = "instructions",
+	[TRACE_TRANSACTION_APPLY] = "instructions",
+	[TRACE_OUTPUT_RENDER] = "damage_rects",
+	[TRACE_EXECUTE_COMMAND] = "results",
+	[TRACE_IPC_MESSAGE] = "type",
+};
+
+bool trace_init(size_t capacity) {
+	if (capacity > TRACE_MAX_RECORDS) {
+		capacity = TRACE_MAX_RECORDS;
+	}
+	size_t size = 1;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	struct sway_trace_record *new_records =
+		calloc(size, sizeof(struct sway_trace_record));
+	if (!new_records) {
+		sway_log(SWAY_ERROR, "Unable to allocate trace buffer");
+		return false;
+	}
+	free(records);
+	records = new_records;
+	records_mask = size - 1;
+	records_written = 0;
+	trace_enabled = true;
+	sway_log(SWAY_DEBUG, "Tracing enabled with %zu records", size);
+	return true;
+}
+
+void trace_fini(void) {
+	trace_enabled = false;
+	free(records);
+	records = NULL;
+	records_mask = 0;
+	records_written = 0;
+}
+
+uint64_t trace_now(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void trace_record(enum sway_trace_point point, uint64_t start_ns, uint32_t arg) {
+	uint64_t duration = trace_now() - start_ns;
+	struct sway_trace_record *record =
+		&records[records_written++ & records_mask];
+	record->start_ns = start_ns;
+	record->duration_ns = duration > UINT32_MAX ? UINT32_MAX : duration;
+	record->arg = arg;
+	record->point = point;
+}
+
+json_object *trace_get_json(void) {
+	json_object *events = json_object_new_array();
+	size_t count = records_written > records_mask + 1 ?
+		records_mask + 1 : records_written;
+	int pid = getpid();
+
+	for (uint64_t i = records_written - count; i < records_written; ++i) {
+		struct sway_trace_record *record = &records[i & records_mask];
+		json_object *event = json_object_new_object();
+		json_object_object_add(event, "name",
+				json_object_new_string(point_names[record->point]));
+		json_object_object_add(event, "cat", json_object_new_string("sway"));
+		json_object_object_add(event, "ph", json_object_new_string("X"));
+		json_object_object_add(event, "ts",
+				json_object_new_double(record->start_ns / 1000.0));
+		json_object_object_add(event, "dur",
+				json_object_new_double(record->duration_ns / 1000.0));
+		json_object_object_add(event, "pid", json_object_new_int(pid));
+		json_object_object_add(event, "tid", json_object_new_int(pid));
+		const char *arg_name = point_arg_names[record->point];
+		if (arg_name) {
+			json_object *args = json_object_new_object();
+			json_object_object_add(args, arg_name,
+					json_object_new_int64(record->arg));
+			json_object_object_add(event, "args", args);
+		}
+		json_object_array_add(events, event);
+	}
+
+	json_object *trace = json_object_new_object();
+	json_object_object_add(trace, "traceEvents", events);
+	json_object_object_add(trace, "displayTimeUnit",
+			json_object_new_string("ns"));
+	return trace;
+}
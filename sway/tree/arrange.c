@@ -13,6 +13,56 @@
 #include "list.h"
 #include "log.h"
 
+/**
+ * Arranging recomputes the geometry of a whole subtree, but in the common case
+ * only a few of its nodes end up somewhere else. Only nodes whose pending state
+ * differs from their current state are added to the next transaction, which
+ * keeps transactions, configures and damage proportional to what changed.
+ *
+ * Structural changes (children being added or removed, focus changes) mark
+ * their nodes dirty where they happen. While a node is referenced by an
+ * in-flight transaction its current state is about to be replaced, so it is
+ * always marked dirty.
+ */
+static bool container_state_changed(struct sway_container *con) {
+	struct sway_container_state *state = &con->current;
+	if (con->node.ntxnrefs) {
+		return true;
+	}
+	return state->layout != con->layout ||
+		state->x != con->x || state->y != con->y ||
+		state->width != con->width || state->height != con->height ||
+		state->fullscreen_mode != con->fullscreen_mode ||
+		state->workspace != con->workspace ||
+		state->parent != con->parent ||
+		state->border != con->border ||
+		state->border_thickness != con->border_thickness ||
+		state->border_top != con->border_top ||
+		state->border_bottom != con->border_bottom ||
+		state->border_left != con->border_left ||
+		state->border_right != con->border_right ||
+		state->content_x != con->content_x ||
+		state->content_y != con->content_y ||
+		state->content_width != con->content_width ||
+		state->content_height != con->content_height ||
+		(!con->view && (!state->children ||
+			!list_items_equal(state->children, con->children)));
+}
+
+static bool workspace_state_changed(struct sway_workspace *ws) {
+	struct sway_workspace_state *state = &ws->current;
+	if (ws->node.ntxnrefs) {
+		return true;
+	}
+	return state->fullscreen != ws->fullscreen ||
+		state->x != ws->x || state->y != ws->y ||
+		state->width != ws->width || state->height != ws->height ||
+		state->layout != ws->layout ||
+		state->output != ws->output ||
+		!state->floating || !list_items_equal(state->floating, ws->floating) ||
+		!state->tiling || !list_items_equal(state->tiling, ws->tiling);
+}
+
 static void apply_horiz_layout(list_t *children, struct wlr_box *parent) {
 	if (!children->length) {
 		return;
@@ -167,13 +217,14 @@ void arrange_container(struct sway_container *container) {
 	}
 	if (container->view) {
 		view_autoconfigure(container->view);
+	} else {
+		struct wlr_box box;
+		container_get_box(container, &box);
+		arrange_children(container->children, container->layout, &box);
+	}
+	if (container_state_changed(container)) {
 		node_set_dirty(&container->node);
-		return;
 	}
-	struct wlr_box box;
-	container_get_box(container, &box);
-	arrange_children(container->children, container->layout, &box);
-	node_set_dirty(&container->node);
 }
 
 void arrange_workspace(struct sway_workspace *workspace) {
@@ -216,7 +267,9 @@ void arrange_workspace(struct sway_workspace *workspace) {
 	}
 
 	workspace_add_gaps(workspace);
-	node_set_dirty(&workspace->node);
+	if (workspace_state_changed(workspace)) {
+		node_set_dirty(&workspace->node);
+	}
 	sway_log(SWAY_DEBUG, "Arranging workspace '%s' at %f, %f", workspace->name,
 			workspace->x, workspace->y);
 	if (workspace->fullscreen) {
@@ -1,5 +1,6 @@
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +13,7 @@
 #include "pango.h"
 #include "sway/config.h"
 #include "sway/desktop.h"
+#include "sway/desktop/text_worker.h"
 #include "sway/desktop/transaction.h"
 #include "sway/input/input-manager.h"
 #include "sway/input/seat.h"
@@ -38,10 +40,11 @@ struct sway_container *container_create(struct sway_view *view) {
 
 	if (!view) {
 		c->children = create_list();
-		c->current.children = create_list();
+		c->current.children = create_list_snapshot(NULL);
 	}
 	c->marks = create_list();
 	c->outputs = create_list();
+	config_track_title_height(c->title_height, c->title_baseline);
 
 	wl_signal_init(&c->events.destroy);
 	wl_signal_emit(&root->events.new_node, &c->node);
@@ -60,19 +63,29 @@ void container_destroy(struct sway_container *con) {
 	}
 	free(con->title);
 	free(con->formatted_title);
-	wlr_texture_destroy(con->title_focused);
-	wlr_texture_destroy(con->title_focused_inactive);
-	wlr_texture_destroy(con->title_unfocused);
-	wlr_texture_destroy(con->title_urgent);
+	text_worker_cancel(&con->title_focused);
+	text_worker_cancel(&con->title_focused_inactive);
+	text_worker_cancel(&con->title_unfocused);
+	text_worker_cancel(&con->title_urgent);
+	text_worker_cancel(&con->marks_focused);
+	text_worker_cancel(&con->marks_focused_inactive);
+	text_worker_cancel(&con->marks_unfocused);
+	text_worker_cancel(&con->marks_urgent);
+	text_worker_release_texture(con->title_focused);
+	text_worker_release_texture(con->title_focused_inactive);
+	text_worker_release_texture(con->title_unfocused);
+	text_worker_release_texture(con->title_urgent);
 	list_free(con->children);
-	list_free(con->current.children);
+	list_snapshot_unref(con->current.children);
+	list_snapshot_unref(con->children_snapshot);
 	list_free(con->outputs);
 
 	list_free_items_and_destroy(con->marks);
-	wlr_texture_destroy(con->marks_focused);
-	wlr_texture_destroy(con->marks_focused_inactive);
-	wlr_texture_destroy(con->marks_unfocused);
-	wlr_texture_destroy(con->marks_urgent);
+	text_worker_release_texture(con->marks_focused);
+	text_worker_release_texture(con->marks_focused_inactive);
+	text_worker_release_texture(con->marks_unfocused);
+	text_worker_release_texture(con->marks_urgent);
+	header_cache_destroy(con->header_cache);
 
 	if (con->view) {
 		if (con->view->container == con) {
@@ -83,9 +96,19 @@ void container_destroy(struct sway_container *con) {
 		}
 	}
 
+	node_finish(&con->node);
 	free(con);
 }
 
+static void container_unindex_marks(struct sway_container *con) {
+	for (int i = 0; i < con->marks->length; ++i) {
+		char *mark = con->marks->items[i];
+		if (hash_get(root->marks, mark) == con) {
+			hash_del(root->marks, mark);
+		}
+	}
+}
+
 void container_begin_destroy(struct sway_container *con) {
 	if (con->view) {
 		ipc_event_window(con, "close");
@@ -102,6 +125,8 @@ void container_begin_destroy(struct sway_container *con) {
 	wl_signal_emit(&con->node.events.destroy, &con->node);
 
 	container_end_mouse_operation(con);
+	container_unindex_marks(con);
+	config_untrack_title_height(con->title_height, con->title_baseline);
 
 	con->node.destroying = true;
 	node_set_dirty(&con->node);
@@ -437,6 +462,83 @@ void container_damage_whole(struct sway_container *container) {
 	}
 }
 
+// Expecting a box in layout coordinates
+static void damage_decoration_box(double x, double y,
+		double width, double height) {
+	if (width <= 0 || height <= 0) {
+		return;
+	}
+	// Pad the box by 1px, because the geometry is a double and might be a
+	// fraction
+	struct wlr_box box = {
+		.x = floor(x) - 1,
+		.y = floor(y) - 1,
+		.width = ceil(x + width) - floor(x) + 2,
+		.height = ceil(y + height) - floor(y) + 2,
+	};
+	for (int i = 0; i < root->outputs->length; ++i) {
+		struct sway_output *output = root->outputs->items[i];
+		struct wlr_box *output_box = wlr_output_layout_get_box(
+			root->output_layout, output->wlr_output);
+		struct wlr_box intersection;
+		if (output_box &&
+				wlr_box_intersection(&intersection, output_box, &box)) {
+			output_damage_box(output, &box);
+		}
+	}
+}
+
+void container_damage_decorations(struct sway_container *con) {
+	struct sway_container_state *state = &con->current;
+	struct sway_workspace *ws = state->workspace;
+	if (!ws) {
+		return;
+	}
+
+	// Children of tabbed and stacked containers have their titlebars drawn in
+	// the parent's header
+	enum sway_container_layout layout = L_NONE;
+	list_t *siblings = NULL;
+	struct wlr_box parent_box;
+	if (state->parent) {
+		struct sway_container_state *parent = &state->parent->current;
+		layout = parent->layout;
+		siblings = parent->children;
+		parent_box.x = parent->x;
+		parent_box.y = parent->y;
+		parent_box.width = parent->width;
+	} else if (list_find(ws->current.tiling, con) != -1) {
+		layout = ws->current.layout;
+		siblings = ws->current.tiling;
+		parent_box.x = ws->current.x;
+		parent_box.y = ws->current.y;
+		parent_box.width = ws->current.width;
+	}
+	if (layout == L_TABBED || layout == L_STACKED) {
+		size_t height = container_titlebar_height();
+		if (layout == L_STACKED) {
+			height *= siblings->length;
+		}
+		damage_decoration_box(parent_box.x, parent_box.y,
+				parent_box.width, height);
+	}
+
+	if (!con->view) {
+		return;
+	}
+	// The titlebar and borders are everything around the content
+	double content_bottom = state->content_y + state->content_height;
+	double content_right = state->content_x + state->content_width;
+	damage_decoration_box(state->x, state->y,
+			state->width, state->content_y - state->y);
+	damage_decoration_box(state->x, content_bottom,
+			state->width, state->y + state->height - content_bottom);
+	damage_decoration_box(state->x, state->content_y,
+			state->content_x - state->x, state->content_height);
+	damage_decoration_box(content_right, state->content_y,
+			state->x + state->width - content_right, state->content_height);
+}
+
 /**
  * Return the output which will be used for scale purposes.
  * This is the most recently entered output.
@@ -448,67 +550,93 @@ struct sway_output *container_get_effective_output(struct sway_container *con) {
 	return con->outputs->items[con->outputs->length - 1];
 }
 
-static void update_title_texture(struct sway_container *con,
-		struct wlr_texture **texture, struct border_colors *class) {
+static void handle_text_texture_done(void *data) {
+	struct sway_container *con = data;
+	++con->texture_serial;
+	container_damage_decorations(con);
+}
+
+static char *format_marks(struct sway_container *con) {
+	size_t len = 0;
+	for (int i = 0; i < con->marks->length; ++i) {
+		char *mark = con->marks->items[i];
+		if (mark[0] != '_') {
+			len += strlen(mark) + 2;
+		}
+	}
+	char *buffer = calloc(len + 1, 1);
+	char *part = malloc(len + 1);
+
+	if (!sway_assert(buffer && part, "Unable to allocate memory")) {
+		free(buffer);
+		free(part);
+		return NULL;
+	}
+
+	for (int i = 0; i < con->marks->length; ++i) {
+		char *mark = con->marks->items[i];
+		if (mark[0] != '_') {
+			sprintf(part, "[%s]", mark);
+			strcat(buffer, part);
+		}
+	}
+	free(part);
+	return buffer;
+}
+
+bool container_get_text_request(struct sway_container *con, bool marks,
+		struct border_colors *class, struct text_texture_request *request) {
 	struct sway_output *output = container_get_effective_output(con);
 	if (!output) {
+		return false;
+	}
+	char *text = NULL;
+	if (marks && con->marks->length) {
+		text = format_marks(con);
+	} else if (!marks && con->formatted_title) {
+		text = strdup(con->formatted_title);
+	}
+	if (!text) {
+		return false;
+	}
+
+	double scale = output->wlr_output->scale;
+	*request = (struct text_texture_request){
+		.font = config->font,
+		.text = text,
+		.scale = scale,
+		.markup = !marks && config->pango_markup,
+		.height = con->title_height * scale,
+		.subpixel_aa = !marks,
+		.subpixel = output->wlr_output->subpixel,
+	};
+	memcpy(request->background, class->background,
+			sizeof(request->background));
+	memcpy(request->foreground, class->text, sizeof(request->foreground));
+	return true;
+}
+
+static void update_text_texture(struct sway_container *con,
+		struct wlr_texture **texture, struct border_colors *class,
+		bool marks) {
+	if (!container_get_effective_output(con)) {
 		return;
 	}
-	if (*texture) {
-		wlr_texture_destroy(*texture);
+	struct text_texture_request request;
+	if (!container_get_text_request(con, marks, class, &request)) {
+		text_worker_cancel(texture);
+		text_worker_release_texture(*texture);
 		*texture = NULL;
-	}
-	if (!con->formatted_title) {
 		return;
 	}
+	text_worker_update_texture(texture, &request,
+			handle_text_texture_done, con);
+	free((char *)request.text);
+}
 
-	double scale = output->wlr_output->scale;
-	int width = 0;
-	int height = con->title_height * scale;
-
-	// We must use a non-nil cairo_t for cairo_set_font_options to work.
-	// Therefore, we cannot use cairo_create(NULL).
-	cairo_surface_t *dummy_surface = cairo_image_surface_create(
-			CAIRO_FORMAT_ARGB32, 0, 0);
-	cairo_t *c = cairo_create(dummy_surface);
-	cairo_set_antialias(c, CAIRO_ANTIALIAS_BEST);
-	cairo_font_options_t *fo = cairo_font_options_create();
-	cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
-	cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
-	cairo_font_options_set_subpixel_order(fo, to_cairo_subpixel_order(output->wlr_output->subpixel));
-	cairo_set_font_options(c, fo);
-	get_text_size(c, config->font, &width, NULL, NULL, scale,
-			config->pango_markup, "%s", con->formatted_title);
-	cairo_surface_destroy(dummy_surface);
-	cairo_destroy(c);
-
-	cairo_surface_t *surface = cairo_image_surface_create(
-			CAIRO_FORMAT_ARGB32, width, height);
-	cairo_t *cairo = cairo_create(surface);
-	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
-	cairo_set_font_options(cairo, fo);
-	cairo_font_options_destroy(fo);
-	cairo_set_source_rgba(cairo, class->background[0], class->background[1],
-			class->background[2], class->background[3]);
-	cairo_paint(cairo);
-	PangoContext *pango = pango_cairo_create_context(cairo);
-	cairo_set_source_rgba(cairo, class->text[0], class->text[1],
-			class->text[2], class->text[3]);
-	cairo_move_to(cairo, 0, 0);
-
-	pango_printf(cairo, config->font, scale, config->pango_markup,
-			"%s", con->formatted_title);
-
-	cairo_surface_flush(surface);
-	unsigned char *data = cairo_image_surface_get_data(surface);
-	int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(
-			output->wlr_output->backend);
-	*texture = wlr_texture_from_pixels(
-			renderer, WL_SHM_FORMAT_ARGB8888, stride, width, height, data);
-	cairo_surface_destroy(surface);
-	g_object_unref(pango);
-	cairo_destroy(cairo);
+static void update_title_texture(struct sway_container *con,
+		struct wlr_texture **texture, struct border_colors *class) {
+	update_text_texture(con, texture, class, false);
 }
 
 void container_update_title_textures(struct sway_container *container) {
@@ -520,20 +648,24 @@ void container_update_title_textures(struct sway_container *container) {
 			&config->border_colors.unfocused);
 	update_title_texture(container, &container->title_urgent,
 			&config->border_colors.urgent);
-	container_damage_whole(container);
+	container_damage_decorations(container);
 }
 
 void container_calculate_title_height(struct sway_container *container) {
-	if (!container->formatted_title) {
-		container->title_height = 0;
-		return;
+	int height = 0;
+	int baseline = 0;
+	if (container->formatted_title) {
+		cairo_t *cairo = cairo_create(NULL);
+		get_text_size(cairo, config->font, NULL, &height, &baseline, 1,
+				config->pango_markup, "%s", container->formatted_title);
+		cairo_destroy(cairo);
+	}
+	// Destroying containers no longer count towards the font height
+	if (!container->node.destroying) {
+		config_untrack_title_height(container->title_height,
+				container->title_baseline);
+		config_track_title_height(height, baseline);
 	}
-	cairo_t *cairo = cairo_create(NULL);
-	int height;
-	int baseline;
-	get_text_size(cairo, config->font, NULL, &height, &baseline, 1,
-			config->pango_markup, "%s", container->formatted_title);
-	cairo_destroy(cairo);
 	container->title_height = height;
 	container->title_baseline = baseline;
 }
@@ -1006,6 +1138,7 @@ static void container_fullscreen_global(struct sway_container *con) {
 	}
 
 	con->fullscreen_mode = FULLSCREEN_GLOBAL;
+	seat_invalidate_focus_cache();
 	container_end_mouse_operation(con);
 	ipc_event_window(con, "fullscreen_mode");
 }
@@ -1049,6 +1182,7 @@ void container_fullscreen_disable(struct sway_container *con) {
 	}
 
 	con->fullscreen_mode = FULLSCREEN_NONE;
+	seat_invalidate_focus_cache();
 	container_end_mouse_operation(con);
 	ipc_event_window(con, "fullscreen_mode");
 
@@ -1305,6 +1439,7 @@ void container_insert_child(struct sway_container *parent,
 	child->parent = parent;
 	child->workspace = parent->workspace;
 	container_for_each_child(child, set_workspace, NULL);
+	seat_invalidate_focus_cache();
 	container_handle_fullscreen_reparent(child);
 	container_update_representation(parent);
 }
@@ -1320,6 +1455,7 @@ void container_add_sibling(struct sway_container *fixed,
 	active->parent = fixed->parent;
 	active->workspace = fixed->workspace;
 	container_for_each_child(active, set_workspace, NULL);
+	seat_invalidate_focus_cache();
 	container_handle_fullscreen_reparent(active);
 	container_update_representation(active);
 }
@@ -1333,6 +1469,7 @@ void container_add_child(struct sway_container *parent,
 	child->parent = parent;
 	child->workspace = parent->workspace;
 	container_for_each_child(child, set_workspace, NULL);
+	seat_invalidate_focus_cache();
 	bool fullscreen = child->fullscreen_mode != FULLSCREEN_NONE ||
 		parent->fullscreen_mode != FULLSCREEN_NONE;
 	set_fullscreen_iterator(child, &fullscreen);
@@ -1363,6 +1500,7 @@ void container_detach(struct sway_container *child) {
 	child->parent = NULL;
 	child->workspace = NULL;
 	container_for_each_child(child, set_workspace, NULL);
+	seat_invalidate_focus_cache();
 
 	if (old_parent) {
 		container_update_representation(old_parent);
@@ -1442,18 +1580,13 @@ bool container_is_transient_for(struct sway_container *child,
 		view_is_transient_for(child->view, ancestor->view);
 }
 
-static bool find_by_mark_iterator(struct sway_container *con, void *data) {
-	char *mark = data;
-	return container_has_mark(con, mark);
-}
-
 struct sway_container *container_find_mark(char *mark) {
-	return root_find_container(find_by_mark_iterator, mark);
+	struct sway_container *con = hash_get(root->marks, mark);
+	return con && !con->node.destroying ? con : NULL;
 }
 
 bool container_find_and_unmark(char *mark) {
-	struct sway_container *con = root_find_container(
-		find_by_mark_iterator, mark);
+	struct sway_container *con = container_find_mark(mark);
 	if (!con) {
 		return false;
 	}
@@ -1461,6 +1594,7 @@ bool container_find_and_unmark(char *mark) {
 	for (int i = 0; i < con->marks->length; ++i) {
 		char *con_mark = con->marks->items[i];
 		if (strcmp(con_mark, mark) == 0) {
+			hash_del(root->marks, con_mark);
 			free(con_mark);
 			list_del(con->marks, i);
 			container_update_marks_textures(con);
@@ -1472,6 +1606,7 @@ bool container_find_and_unmark(char *mark) {
 }
 
 void container_clear_marks(struct sway_container *con) {
+	container_unindex_marks(con);
 	for (int i = 0; i < con->marks->length; ++i) {
 		free(con->marks->items[i]);
 	}
@@ -1490,82 +1625,15 @@ bool container_has_mark(struct sway_container *con, char *mark) {
 }
 
 void container_add_mark(struct sway_container *con, char *mark) {
-	list_add(con->marks, strdup(mark));
+	char *copy = strdup(mark);
+	list_add(con->marks, copy);
+	hash_set(root->marks, copy, con);
 	ipc_event_window(con, "mark");
 }
 
 static void update_marks_texture(struct sway_container *con,
 		struct wlr_texture **texture, struct border_colors *class) {
-	struct sway_output *output = container_get_effective_output(con);
-	if (!output) {
-		return;
-	}
-	if (*texture) {
-		wlr_texture_destroy(*texture);
-		*texture = NULL;
-	}
-	if (!con->marks->length) {
-		return;
-	}
-
-	size_t len = 0;
-	for (int i = 0; i < con->marks->length; ++i) {
-		char *mark = con->marks->items[i];
-		if (mark[0] != '_') {
-			len += strlen(mark) + 2;
-		}
-	}
-	char *buffer = calloc(len + 1, 1);
-	char *part = malloc(len + 1);
-
-	if (!sway_assert(buffer && part, "Unable to allocate memory")) {
-		free(buffer);
-		return;
-	}
-
-	for (int i = 0; i < con->marks->length; ++i) {
-		char *mark = con->marks->items[i];
-		if (mark[0] != '_') {
-			sprintf(part, "[%s]", mark);
-			strcat(buffer, part);
-		}
-	}
-	free(part);
-
-	double scale = output->wlr_output->scale;
-	int width = 0;
-	int height = con->title_height * scale;
-
-	cairo_t *c = cairo_create(NULL);
-	get_text_size(c, config->font, &width, NULL, NULL, scale, false,
-			"%s", buffer);
-	cairo_destroy(c);
-
-	cairo_surface_t *surface = cairo_image_surface_create(
-			CAIRO_FORMAT_ARGB32, width, height);
-	cairo_t *cairo = cairo_create(surface);
-	cairo_set_source_rgba(cairo, class->background[0], class->background[1],
-			class->background[2], class->background[3]);
-	cairo_paint(cairo);
-	PangoContext *pango = pango_cairo_create_context(cairo);
-	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
-	cairo_set_source_rgba(cairo, class->text[0], class->text[1],
-			class->text[2], class->text[3]);
-	cairo_move_to(cairo, 0, 0);
-
-	pango_printf(cairo, config->font, scale, false, "%s", buffer);
-
-	cairo_surface_flush(surface);
-	unsigned char *data = cairo_image_surface_get_data(surface);
-	int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
-	struct wlr_renderer *renderer = wlr_backend_get_renderer(
-			output->wlr_output->backend);
-	*texture = wlr_texture_from_pixels(
-			renderer, WL_SHM_FORMAT_ARGB8888, stride, width, height, data);
-	cairo_surface_destroy(surface);
-	g_object_unref(pango);
-	cairo_destroy(cairo);
-	free(buffer);
+	update_text_texture(con, texture, class, true);
 }
 
 void container_update_marks_textures(struct sway_container *con) {
@@ -1580,7 +1648,7 @@ void container_update_marks_textures(struct sway_container *con) {
 			&config->border_colors.unfocused);
 	update_marks_texture(con, &con->marks_urgent,
 			&config->border_colors.urgent);
-	container_damage_whole(con);
+	container_damage_decorations(con);
 }
 
 void container_raise_floating(struct sway_container *con) {
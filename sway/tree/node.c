@@ -5,14 +5,31 @@
 #include "sway/tree/node.h"
 #include "sway/tree/root.h"
 #include "sway/tree/workspace.h"
+#include "hash.h"
 #include "log.h"
 
+static hash_t *nodes_by_id = NULL; // size_t -> struct sway_node
+
 void node_init(struct sway_node *node, enum sway_node_type type, void *thing) {
 	static size_t next_id = 1;
 	node->id = next_id++;
 	node->type = type;
 	node->sway_root = thing;
 	wl_signal_init(&node->events.destroy);
+
+	if (!nodes_by_id) {
+		nodes_by_id = create_hash(NULL, NULL);
+	}
+	hash_set(nodes_by_id, (void *)node->id, node);
+}
+
+void node_finish(struct sway_node *node) {
+	hash_del(nodes_by_id, (void *)node->id);
+}
+
+struct sway_node *node_from_id(size_t id) {
+	struct sway_node *node = hash_get(nodes_by_id, (void *)id);
+	return node && !node->destroying ? node : NULL;
 }
 
 const char *node_type_to_str(enum sway_node_type type) {
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <strings.h>
 #include <wlr/types/wlr_output_damage.h>
+#include "sway/input/seat.h"
 #include "sway/ipc-server.h"
 #include "sway/layers.h"
 #include "sway/output.h"
@@ -99,7 +100,7 @@ struct sway_output *output_create(struct wlr_output *wlr_output) {
 	wl_list_insert(&root->all_outputs, &output->link);
 
 	output->workspaces = create_list();
-	output->current.workspaces = create_list();
+	output->current.workspaces = create_list_snapshot(NULL);
 
 	return output;
 }
@@ -239,7 +240,9 @@ void output_destroy(struct sway_output *output) {
 		return;
 	}
 	list_free(output->workspaces);
-	list_free(output->current.workspaces);
+	list_snapshot_unref(output->current.workspaces);
+	list_snapshot_unref(output->workspaces_snapshot);
+	node_finish(&output->node);
 	free(output);
 }
 
@@ -313,6 +316,7 @@ void output_add_workspace(struct sway_output *output,
 	}
 	list_add(output->workspaces, workspace);
 	workspace->output = output;
+	seat_invalidate_focus_cache();
 	node_set_dirty(&output->node);
 	node_set_dirty(&workspace->node);
 }
@@ -39,6 +39,8 @@ struct sway_root *root_create(void) {
 	wl_signal_init(&root->events.new_node);
 	root->outputs = create_list();
 	root->scratchpad = create_list();
+	root->marks = create_hash(hash_str, hash_str_equal);
+	root->workspaces = create_hash(hash_str_case, hash_str_case_equal);
 
 	root->output_layout_change.notify = output_layout_handle_change;
 	wl_signal_add(&root->output_layout->events.change,
@@ -50,7 +52,10 @@ void root_destroy(struct sway_root *root) {
 	wl_list_remove(&root->output_layout_change.link);
 	list_free(root->scratchpad);
 	list_free(root->outputs);
+	hash_free(root->marks);
+	hash_free(root->workspaces);
 	wlr_output_layout_destroy(root->output_layout);
+	node_finish(&root->node);
 	free(root);
 }
 
@@ -76,6 +81,7 @@ void root_scratchpad_add_container(struct sway_container *con, struct sway_works
 
 	container_detach(con);
 	con->scratchpad = true;
+	seat_invalidate_focus_cache();
 	list_add(root->scratchpad, con);
 	if (ws) {
 		workspace_add_floating(ws, con);
@@ -103,6 +109,7 @@ void root_scratchpad_remove_container(struct sway_container *con) {
 		return;
 	}
 	con->scratchpad = false;
+	seat_invalidate_focus_cache();
 	int index = list_find(root->scratchpad, con);
 	if (index != -1) {
 		list_del(root->scratchpad, index);
@@ -21,6 +21,7 @@
 #include "sway/ipc-server.h"
 #include "sway/output.h"
 #include "sway/input/seat.h"
+#include "sway/trace.h"
 #include "sway/tree/arrange.h"
 #include "sway/tree/container.h"
 #include "sway/tree/view.h"
@@ -572,6 +573,7 @@ void view_map(struct sway_view *view, struct wlr_surface *wlr_surface,
 	if (!sway_assert(view->surface == NULL, "cannot map mapped view")) {
 		return;
 	}
+	uint64_t trace_start = trace_begin();
 	view->surface = wlr_surface;
 
 	// If there is a request to be opened fullscreen on a specific output, try
@@ -655,6 +657,8 @@ void view_map(struct sway_view *view, struct wlr_surface *wlr_surface,
 	if (should_focus(view)) {
 		input_manager_set_focus(&view->container->node);
 	}
+
+	trace_end(TRACE_VIEW_MAP, trace_start, 0);
 }
 
 void view_unmap(struct sway_view *view) {
@@ -1146,7 +1150,11 @@ void view_set_urgent(struct sway_view *view, bool enable) {
 			view->urgent_timer = NULL;
 		}
 	}
-	container_damage_whole(view->container);
+	// Ancestors show the urgency in their tabs
+	for (struct sway_container *con = view->container; con;
+			con = con->current.parent) {
+		container_damage_decorations(con);
+	}
 
 	ipc_event_window(view->container, "urgent");
 
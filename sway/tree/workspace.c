@@ -69,6 +69,30 @@ static void prevent_invalid_outer_gaps(struct sway_workspace *ws) {
 	}
 }
 
+static void workspace_index_name(struct sway_workspace *ws) {
+	hash_set(root->workspaces, ws->name, ws);
+}
+
+static void unindex_iterator(struct sway_workspace *ws, void *data) {
+	struct sway_workspace *removed = data;
+	if (ws != removed && strcasecmp(ws->name, removed->name) == 0) {
+		workspace_index_name(ws);
+	}
+}
+
+static void workspace_unindex_name(struct sway_workspace *ws) {
+	if (hash_get(root->workspaces, ws->name) != ws) {
+		return;
+	}
+	hash_del(root->workspaces, ws->name);
+	// A workspace saved on the noop output can share the name with one on an
+	// enabled output, so keep any other workspace with this name indexed
+	root_for_each_workspace(unindex_iterator, ws);
+	if (root->noop_output) {
+		output_for_each_workspace(root->noop_output, unindex_iterator, ws);
+	}
+}
+
 struct sway_workspace *workspace_create(struct sway_output *output,
 		const char *name) {
 	if (output == NULL) {
@@ -85,6 +109,9 @@ struct sway_workspace *workspace_create(struct sway_output *output,
 	}
 	node_init(&ws->node, N_WORKSPACE, ws);
 	ws->name = name ? strdup(name) : NULL;
+	if (ws->name) {
+		workspace_index_name(ws);
+	}
 	ws->prev_split_layout = L_NONE;
 	ws->layout = output_get_default_layout(output);
 	ws->floating = create_list();
@@ -152,8 +179,12 @@ void workspace_destroy(struct sway_workspace *workspace) {
 	list_free_items_and_destroy(workspace->output_priority);
 	list_free(workspace->floating);
 	list_free(workspace->tiling);
-	list_free(workspace->current.floating);
-	list_free(workspace->current.tiling);
+	list_snapshot_unref(workspace->current.floating);
+	list_snapshot_unref(workspace->current.tiling);
+	list_snapshot_unref(workspace->floating_snapshot);
+	list_snapshot_unref(workspace->tiling_snapshot);
+	header_cache_destroy(workspace->header_cache);
+	node_finish(&workspace->node);
 	free(workspace);
 }
 
@@ -161,6 +192,7 @@ void workspace_begin_destroy(struct sway_workspace *workspace) {
 	sway_log(SWAY_DEBUG, "Destroying workspace '%s'", workspace->name);
 	ipc_event_workspace(NULL, workspace, "empty"); // intentional
 	wl_signal_emit(&workspace->node.events.destroy, &workspace->node);
+	workspace_unindex_name(workspace);
 
 	if (workspace->output) {
 		workspace_detach(workspace);
@@ -169,6 +201,13 @@ void workspace_begin_destroy(struct sway_workspace *workspace) {
 	node_set_dirty(&workspace->node);
 }
 
+void workspace_set_name(struct sway_workspace *workspace, char *name) {
+	workspace_unindex_name(workspace);
+	free(workspace->name);
+	workspace->name = name;
+	workspace_index_name(workspace);
+}
+
 void workspace_consider_destroy(struct sway_workspace *ws) {
 	if (ws->tiling->length || ws->floating->length) {
 		return;
@@ -364,6 +403,16 @@ static bool _workspace_by_name(struct sway_workspace *ws, void *data) {
 	return strcasecmp(ws->name, data) == 0;
 }
 
+static struct sway_workspace *workspace_find_name(const char *name) {
+	struct sway_workspace *ws = hash_get(root->workspaces, name);
+	if (!ws || (ws->output && list_find(root->outputs, ws->output) != -1)) {
+		return ws;
+	}
+	// Indexed workspace is saved on the noop output, but an enabled output
+	// might have another one by the same name
+	return root_find_workspace(_workspace_by_name, (void *)name);
+}
+
 struct sway_workspace *workspace_by_name(const char *name) {
 	struct sway_seat *seat = input_manager_current_seat();
 	struct sway_workspace *current = seat_get_focused_workspace(seat);
@@ -383,10 +432,9 @@ struct sway_workspace *workspace_by_name(const char *name) {
 		if (!seat->prev_workspace_name) {
 			return NULL;
 		}
-		return root_find_workspace(_workspace_by_name,
-				(void*)seat->prev_workspace_name);
+		return workspace_find_name(seat->prev_workspace_name);
 	} else {
-		return root_find_workspace(_workspace_by_name, (void*)name);
+		return workspace_find_name(name);
 	}
 }
 
@@ -647,6 +695,7 @@ void workspace_detach(struct sway_workspace *workspace) {
 		list_del(output->workspaces, index);
 	}
 	workspace->output = NULL;
+	seat_invalidate_focus_cache();
 
 	node_set_dirty(&workspace->node);
 	node_set_dirty(&output->node);
@@ -664,6 +713,7 @@ void workspace_add_tiling(struct sway_workspace *workspace,
 	list_add(workspace->tiling, con);
 	con->workspace = workspace;
 	container_for_each_child(con, set_workspace, NULL);
+	seat_invalidate_focus_cache();
 	container_handle_fullscreen_reparent(con);
 	workspace_update_representation(workspace);
 	node_set_dirty(&workspace->node);
@@ -678,6 +728,7 @@ void workspace_add_floating(struct sway_workspace *workspace,
 	list_add(workspace->floating, con);
 	con->workspace = workspace;
 	container_for_each_child(con, set_workspace, NULL);
+	seat_invalidate_focus_cache();
 	container_handle_fullscreen_reparent(con);
 	node_set_dirty(&workspace->node);
 	node_set_dirty(&con->node);
@@ -694,6 +745,7 @@ void workspace_insert_tiling(struct sway_workspace *workspace,
 	list_insert(workspace->tiling, index, con);
 	con->workspace = workspace;
 	container_for_each_child(con, set_workspace, NULL);
+	seat_invalidate_focus_cache();
 	container_handle_fullscreen_reparent(con);
 	workspace_update_representation(workspace);
 	node_set_dirty(&workspace->node);
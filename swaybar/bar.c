@@ -30,13 +30,17 @@
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "xdg-output-unstable-v1-client-protocol.h"
 
+void free_workspace(struct swaybar_workspace *ws) {
+	wl_list_remove(&ws->link);
+	free(ws->name);
+	free(ws->label);
+	free(ws);
+}
+
 void free_workspaces(struct wl_list *list) {
 	struct swaybar_workspace *ws, *tmp;
 	wl_list_for_each_safe(ws, tmp, list, link) {
-		wl_list_remove(&ws->link);
-		free(ws->name);
-		free(ws->label);
-		free(ws);
+		free_workspace(ws);
 	}
 }
 
@@ -56,8 +60,8 @@ static void swaybar_output_free(struct swaybar_output *output) {
 	}
 	zxdg_output_v1_destroy(output->xdg_output);
 	wl_output_destroy(output->output);
-	destroy_buffer(&output->buffers[0]);
-	destroy_buffer(&output->buffers[1]);
+	finish_buffer_pool(&output->buffers);
+	list_free_items_and_destroy(output->regions);
 	free_hotspots(&output->hotspots);
 	free_workspaces(&output->workspaces);
 	wl_list_remove(&output->link);
@@ -269,6 +273,11 @@ static void xdg_output_handle_done(void *data,
 		output->surface = wl_compositor_create_surface(bar->compositor);
 		assert(output->surface);
 
+		// The workspaces are fetched during setup, but an output added
+		// later only learns of its own through a resync
+		if (bar->running && bar->config->workspace_buttons) {
+			ipc_request_workspaces(bar);
+		}
 		determine_bar_visibility(bar, false);
 	}
 }
@@ -351,6 +360,11 @@ static void handle_global(void *data, struct wl_registry *registry,
 		wl_list_init(&output->workspaces);
 		wl_list_init(&output->hotspots);
 		wl_list_init(&output->link);
+		output->regions = create_list();
+		init_buffer_pool(&output->buffers, 2);
+		for (size_t i = 0; i < POOL_BUFFERS_MAX; ++i) {
+			output->buffer_damage[i].whole = true;
+		}
 		if (bar->xdg_output_manager != NULL) {
 			add_xdg_output(output);
 		}
@@ -392,6 +406,7 @@ bool bar_setup(struct swaybar *bar, const char *socket_path) {
 	bar->config = init_config();
 	wl_list_init(&bar->outputs);
 	wl_list_init(&bar->seats);
+	bar->status_renders = create_list();
 	bar->eventloop = loop_create();
 
 	bar->ipc_socketfd = ipc_open_socket(socket_path);
@@ -451,13 +466,6 @@ static void display_in(int fd, short mask, void *data) {
 	}
 }
 
-static void ipc_in(int fd, short mask, void *data) {
-	struct swaybar *bar = data;
-	if (handle_ipc_readable(bar)) {
-		set_bar_dirty(bar);
-	}
-}
-
 static void status_in(int fd, short mask, void *data) {
 	struct swaybar *bar = data;
 	if (mask & (POLLHUP | POLLERR)) {
@@ -472,7 +480,6 @@ static void status_in(int fd, short mask, void *data) {
 void bar_run(struct swaybar *bar) {
 	loop_add_fd(bar->eventloop, wl_display_get_fd(bar->display), POLLIN,
 			display_in, bar);
-	loop_add_fd(bar->eventloop, bar->ipc_event_socketfd, POLLIN, ipc_in, bar);
 	if (bar->status) {
 		loop_add_fd(bar->eventloop, bar->status->read_fd, POLLIN,
 				status_in, bar);
@@ -511,9 +518,11 @@ void bar_teardown(struct swaybar *bar) {
 #endif
 	free_outputs(&bar->outputs);
 	free_seats(&bar->seats);
+	destroy_status_renders(bar);
 	if (bar->config) {
 		free_config(bar->config);
 	}
+	ipc_client_destroy(bar->ipc_client);
 	close(bar->ipc_event_socketfd);
 	close(bar->ipc_socketfd);
 	if (bar->status) {
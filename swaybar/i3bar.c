@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "list.h"
 #include "log.h"
 #include "swaybar/bar.h"
 #include "swaybar/config.h"
@@ -29,87 +30,217 @@ void i3bar_block_unref(struct i3bar_block *block) {
 	}
 }
 
-static void i3bar_parse_json(struct status_line *status,
+static bool update_string(char **dst, const char *src) {
+	if (*dst == NULL ? src == NULL : src != NULL && strcmp(*dst, src) == 0) {
+		return false;
+	}
+	free(*dst);
+	*dst = src ? strdup(src) : NULL;
+	return true;
+}
+
+static bool update_int(int *dst, int value) {
+	if (*dst == value) {
+		return false;
+	}
+	*dst = value;
+	return true;
+}
+
+static bool update_bool(bool *dst, bool value) {
+	if (*dst == value) {
+		return false;
+	}
+	*dst = value;
+	return true;
+}
+
+static bool update_color(uint32_t *dst, uint32_t value) {
+	if (*dst == value) {
+		return false;
+	}
+	*dst = value;
+	return true;
+}
+
+/**
+ * Update the block from its json. Only the fields which differ are replaced.
+ * Returns true if anything changed.
+ */
+static bool i3bar_block_update(struct i3bar_block *block, json_object *json) {
+	json_object *full_text, *short_text, *color, *min_width, *align, *urgent;
+	json_object *name, *instance, *separator, *separator_block_width;
+	json_object *background, *border, *border_top, *border_bottom;
+	json_object *border_left, *border_right, *markup;
+	json_object_object_get_ex(json, "full_text", &full_text);
+	json_object_object_get_ex(json, "short_text", &short_text);
+	json_object_object_get_ex(json, "color", &color);
+	json_object_object_get_ex(json, "min_width", &min_width);
+	json_object_object_get_ex(json, "align", &align);
+	json_object_object_get_ex(json, "urgent", &urgent);
+	json_object_object_get_ex(json, "name", &name);
+	json_object_object_get_ex(json, "instance", &instance);
+	json_object_object_get_ex(json, "markup", &markup);
+	json_object_object_get_ex(json, "separator", &separator);
+	json_object_object_get_ex(json, "separator_block_width", &separator_block_width);
+	json_object_object_get_ex(json, "background", &background);
+	json_object_object_get_ex(json, "border", &border);
+	json_object_object_get_ex(json, "border_top", &border_top);
+	json_object_object_get_ex(json, "border_bottom", &border_bottom);
+	json_object_object_get_ex(json, "border_left", &border_left);
+	json_object_object_get_ex(json, "border_right", &border_right);
+
+	bool changed = false;
+	changed |= update_string(&block->full_text,
+			full_text ? json_object_get_string(full_text) : NULL);
+	changed |= update_string(&block->short_text,
+			short_text ? json_object_get_string(short_text) : NULL);
+	if (color) {
+		uint32_t value = parse_color(json_object_get_string(color));
+		if (!block->color) {
+			block->color = malloc(sizeof(uint32_t));
+			*block->color = ~value;
+		}
+		changed |= update_color(block->color, value);
+	} else if (block->color) {
+		free(block->color);
+		block->color = NULL;
+		changed = true;
+	}
+	json_type min_width_type = min_width ?
+		json_object_get_type(min_width) : json_type_null;
+	if (min_width_type == json_type_string) {
+		/* the width will be calculated when rendering */
+		changed |= update_string(&block->min_width_str,
+				json_object_get_string(min_width));
+	} else {
+		changed |= update_string(&block->min_width_str, NULL);
+		changed |= update_int(&block->min_width,
+				min_width_type == json_type_int ?
+				json_object_get_int(min_width) : 0);
+	}
+	changed |= update_string(&block->align,
+			align ? json_object_get_string(align) : "left");
+	changed |= update_bool(&block->urgent,
+			urgent ? json_object_get_int(urgent) : false);
+	changed |= update_string(&block->name,
+			name ? json_object_get_string(name) : NULL);
+	changed |= update_string(&block->instance,
+			instance ? json_object_get_string(instance) : NULL);
+	changed |= update_bool(&block->markup, markup &&
+			strcmp(json_object_get_string(markup), "pango") == 0);
+	changed |= update_bool(&block->separator,
+			separator ? json_object_get_int(separator) : true);
+	changed |= update_int(&block->separator_block_width,
+			separator_block_width ?
+			json_object_get_int(separator_block_width) : 9);
+	// Airblader features
+	changed |= update_color(&block->background, background ?
+			parse_color(json_object_get_string(background)) : 0);
+	changed |= update_color(&block->border, border ?
+			parse_color(json_object_get_string(border)) : 0);
+	changed |= update_int(&block->border_top,
+			border_top ? json_object_get_int(border_top) : 1);
+	changed |= update_int(&block->border_bottom,
+			border_bottom ? json_object_get_int(border_bottom) : 1);
+	changed |= update_int(&block->border_left,
+			border_left ? json_object_get_int(border_left) : 1);
+	changed |= update_int(&block->border_right,
+			border_right ? json_object_get_int(border_right) : 1);
+	return changed;
+}
+
+static bool strings_equal(const char *a, const char *b) {
+	return a == NULL ? b == NULL : b != NULL && strcmp(a, b) == 0;
+}
+
+/**
+ * Find the existing block for a new one, by its name and instance or, if it
+ * has no name, by its position. The block is taken out of the list.
+ */
+static struct i3bar_block *take_block(list_t *blocks, size_t index,
+		json_object *json, size_t *taken) {
+	json_object *name, *instance;
+	json_object_object_get_ex(json, "name", &name);
+	json_object_object_get_ex(json, "instance", &instance);
+	const char *name_str = name ? json_object_get_string(name) : NULL;
+	const char *instance_str =
+		instance ? json_object_get_string(instance) : NULL;
+
+	if (!name_str) {
+		if (index >= (size_t)blocks->length) {
+			return NULL;
+		}
+		struct i3bar_block *block = blocks->items[index];
+		if (!block || block->name) {
+			return NULL;
+		}
+		blocks->items[index] = NULL;
+		*taken = index;
+		return block;
+	}
+
+	for (int i = 0; i < blocks->length; ++i) {
+		struct i3bar_block *block = blocks->items[i];
+		if (block && strings_equal(block->name, name_str) &&
+				strings_equal(block->instance, instance_str)) {
+			blocks->items[i] = NULL;
+			*taken = i;
+			return block;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Match the blocks in the json to the current ones, and update those in place.
+ * Returns true if any block changed, or blocks were added, removed or
+ * reordered.
+ */
+static bool i3bar_parse_json(struct status_line *status,
 		struct json_object *json_array) {
-	struct i3bar_block *block, *tmp;
-	wl_list_for_each_safe(block, tmp, &status->blocks, link) {
-		wl_list_remove(&block->link);
-		i3bar_block_unref(block);
+	static uint32_t serial = 0;
+
+	// The blocks are stored last to first
+	list_t *old_blocks = create_list();
+	struct i3bar_block *block;
+	wl_list_for_each_reverse(block, &status->blocks, link) {
+		list_add(old_blocks, block);
 	}
-	for (size_t i = 0; i < json_object_array_length(json_array); ++i) {
-		json_object *full_text, *short_text, *color, *min_width, *align, *urgent;
-		json_object *name, *instance, *separator, *separator_block_width;
-		json_object *background, *border, *border_top, *border_bottom;
-		json_object *border_left, *border_right, *markup;
+	wl_list_init(&status->blocks);
+
+	size_t length = json_object_array_length(json_array);
+	bool changed = length != (size_t)old_blocks->length;
+	for (size_t i = 0; i < length; ++i) {
 		json_object *json = json_object_array_get_idx(json_array, i);
 		if (!json) {
 			continue;
 		}
-		json_object_object_get_ex(json, "full_text", &full_text);
-		json_object_object_get_ex(json, "short_text", &short_text);
-		json_object_object_get_ex(json, "color", &color);
-		json_object_object_get_ex(json, "min_width", &min_width);
-		json_object_object_get_ex(json, "align", &align);
-		json_object_object_get_ex(json, "urgent", &urgent);
-		json_object_object_get_ex(json, "name", &name);
-		json_object_object_get_ex(json, "instance", &instance);
-		json_object_object_get_ex(json, "markup", &markup);
-		json_object_object_get_ex(json, "separator", &separator);
-		json_object_object_get_ex(json, "separator_block_width", &separator_block_width);
-		json_object_object_get_ex(json, "background", &background);
-		json_object_object_get_ex(json, "border", &border);
-		json_object_object_get_ex(json, "border_top", &border_top);
-		json_object_object_get_ex(json, "border_bottom", &border_bottom);
-		json_object_object_get_ex(json, "border_left", &border_left);
-		json_object_object_get_ex(json, "border_right", &border_right);
 
-		struct i3bar_block *block = calloc(1, sizeof(struct i3bar_block));
-		block->ref_count = 1;
-		block->full_text = full_text ?
-			strdup(json_object_get_string(full_text)) : NULL;
-		block->short_text = short_text ?
-			strdup(json_object_get_string(short_text)) : NULL;
-		if (color) {
-			block->color = malloc(sizeof(uint32_t));
-			*block->color = parse_color(json_object_get_string(color));
+		size_t taken;
+		block = take_block(old_blocks, i, json, &taken);
+		if (!block) {
+			block = calloc(1, sizeof(struct i3bar_block));
+			block->ref_count = 1;
+			changed = true;
+		} else if (taken != i) {
+			changed = true;
 		}
-		if (min_width) {
-			json_type type = json_object_get_type(min_width);
-			if (type == json_type_int) {
-				block->min_width = json_object_get_int(min_width);
-			} else if (type == json_type_string) {
-				/* the width will be calculated when rendering */
-				block->min_width_str = strdup(json_object_get_string(min_width));
-			}
+		if (i3bar_block_update(block, json)) {
+			block->serial = ++serial;
+			changed = true;
 		}
-		block->align = strdup(align ? json_object_get_string(align) : "left");
-		block->urgent = urgent ? json_object_get_int(urgent) : false;
-		block->name = name ? strdup(json_object_get_string(name)) : NULL;
-		block->instance = instance ?
-			strdup(json_object_get_string(instance)) : NULL;
-		if (markup) {
-			block->markup = false;
-			const char *markup_str = json_object_get_string(markup);
-			if (strcmp(markup_str, "pango") == 0) {
-				block->markup = true;
-			}
-		}
-		block->separator = separator ? json_object_get_int(separator) : true;
-		block->separator_block_width = separator_block_width ?
-			json_object_get_int(separator_block_width) : 9;
-		// Airblader features
-		block->background = background ?
-			parse_color(json_object_get_string(background)) : 0;
-		block->border = border ? 
-			parse_color(json_object_get_string(border)) : 0;
-		block->border_top = border_top ? json_object_get_int(border_top) : 1;
-		block->border_bottom = border_bottom ?
-			json_object_get_int(border_bottom) : 1;
-		block->border_left = border_left ? json_object_get_int(border_left) : 1;
-		block->border_right = border_right ?
-			json_object_get_int(border_right) : 1;
 		wl_list_insert(&status->blocks, &block->link);
 	}
+
+	for (int i = 0; i < old_blocks->length; ++i) {
+		if (old_blocks->items[i]) {
+			i3bar_block_unref(old_blocks->items[i]);
+			changed = true;
+		}
+	}
+	list_free(old_blocks);
+	return changed;
 }
 
 bool i3bar_handle_readable(struct status_line *status) {
@@ -251,10 +382,11 @@ bool i3bar_handle_readable(struct status_line *status) {
 	}
 
 	if (last_object) {
-		sway_log(SWAY_DEBUG, "Rendering last received json");
-		i3bar_parse_json(status, last_object);
+		bool changed = i3bar_parse_json(status, last_object);
+		sway_log(SWAY_DEBUG, changed ? "Rendering last received json" :
+				"Last received json didn't change any blocks");
 		json_object_put(last_object);
-		return true;
+		return changed;
 	} else {
 		return false;
 	}
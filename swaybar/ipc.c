@@ -34,7 +34,7 @@ void ipc_send_workspace_command(struct swaybar *bar, const char *ws) {
 		command[d++] = ws[i];
 	}
 
-	ipc_single_command(bar->ipc_socketfd, IPC_COMMAND, command, &size);
+	ipc_client_send(bar->ipc_client, IPC_COMMAND, command, size, NULL, NULL);
 	free(command);
 }
 
@@ -352,65 +352,74 @@ static bool ipc_parse_config(
 	return true;
 }
 
-bool ipc_get_workspaces(struct swaybar *bar) {
+static void workspace_set_name(struct swaybar *bar,
+		struct swaybar_workspace *ws, const char *name, int num) {
+	free(ws->name);
+	free(ws->label);
+	ws->num = num;
+	ws->name = strdup(name);
+	ws->label = strdup(ws->name);
+	// ws->num will be -1 if workspace name doesn't begin with int.
+	if (ws->num != -1) {
+		size_t len_offset = snprintf(NULL, 0, "%d", ws->num);
+		if (bar->config->strip_workspace_name) {
+			free(ws->label);
+			ws->label = malloc(len_offset + 1);
+			snprintf(ws->label, len_offset + 1, "%d", ws->num);
+		} else if (bar->config->strip_workspace_numbers) {
+			len_offset += ws->label[len_offset] == ':';
+			if (ws->name[len_offset] != '\0') {
+				free(ws->label);
+				// Strip number prefix [1-?:] using len_offset.
+				ws->label = strdup(ws->name + len_offset);
+			}
+		}
+	}
+}
+
+static struct swaybar_workspace *create_workspace(struct swaybar *bar,
+		json_object *ws_json) {
+	json_object *id, *num, *name, *urgent;
+	json_object_object_get_ex(ws_json, "id", &id);
+	json_object_object_get_ex(ws_json, "num", &num);
+	json_object_object_get_ex(ws_json, "name", &name);
+	json_object_object_get_ex(ws_json, "urgent", &urgent);
+
+	struct swaybar_workspace *ws = calloc(1, sizeof(struct swaybar_workspace));
+	ws->id = json_object_get_int(id);
+	workspace_set_name(bar, ws, json_object_get_string(name),
+			json_object_get_int(num));
+	ws->urgent = json_object_get_boolean(urgent);
+	return ws;
+}
+
+static bool parse_workspaces(struct swaybar *bar, json_object *results) {
 	struct swaybar_output *output;
 	wl_list_for_each(output, &bar->outputs, link) {
 		free_workspaces(&output->workspaces);
 		output->focused = false;
 	}
-	uint32_t len = 0;
-	char *res = ipc_single_command(bar->ipc_socketfd,
-			IPC_GET_WORKSPACES, NULL, &len);
-	json_object *results = json_tokener_parse(res);
-	if (!results) {
-		free(res);
-		return false;
-	}
 
 	bar->visible_by_urgency = false;
 	size_t length = json_object_array_length(results);
 	json_object *ws_json;
-	json_object *num, *name, *visible, *focused, *out, *urgent;
+	json_object *visible, *focused, *out;
 	for (size_t i = 0; i < length; ++i) {
 		ws_json = json_object_array_get_idx(results, i);
 
-		json_object_object_get_ex(ws_json, "num", &num);
-		json_object_object_get_ex(ws_json, "name", &name);
 		json_object_object_get_ex(ws_json, "visible", &visible);
 		json_object_object_get_ex(ws_json, "focused", &focused);
 		json_object_object_get_ex(ws_json, "output", &out);
-		json_object_object_get_ex(ws_json, "urgent", &urgent);
 
 		wl_list_for_each(output, &bar->outputs, link) {
 			const char *ws_output = json_object_get_string(out);
 			if (strcmp(ws_output, output->name) == 0) {
-				struct swaybar_workspace *ws =
-					calloc(1, sizeof(struct swaybar_workspace));
-				ws->num = json_object_get_int(num);
-				ws->name = strdup(json_object_get_string(name));
-				ws->label = strdup(ws->name);
-				// ws->num will be -1 if workspace name doesn't begin with int.
-				if (ws->num != -1) {
-					size_t len_offset = snprintf(NULL, 0, "%d", ws->num);
-					if (bar->config->strip_workspace_name) {
-						free(ws->label);
-						ws->label = malloc(len_offset + 1);
-						snprintf(ws->label, len_offset + 1, "%d", ws->num);
-					} else if (bar->config->strip_workspace_numbers) {
-						len_offset += ws->label[len_offset] == ':';
-						if (ws->name[len_offset] != '\0') {
-							free(ws->label);
-							// Strip number prefix [1-?:] using len_offset.
-							ws->label = strdup(ws->name + len_offset);
-						}
-					}
-				}
+				struct swaybar_workspace *ws = create_workspace(bar, ws_json);
 				ws->visible = json_object_get_boolean(visible);
 				ws->focused = json_object_get_boolean(focused);
 				if (ws->focused) {
 					output->focused = true;
 				}
-				ws->urgent = json_object_get_boolean(urgent);
 				if (ws->urgent) {
 					bar->visible_by_urgency = true;
 				}
@@ -418,9 +427,253 @@ bool ipc_get_workspaces(struct swaybar *bar) {
 			}
 		}
 	}
+	return determine_bar_visibility(bar, false);
+}
+
+bool ipc_get_workspaces(struct swaybar *bar) {
+	uint32_t len = 0;
+	char *res = ipc_single_command(bar->ipc_socketfd,
+			IPC_GET_WORKSPACES, NULL, &len);
+	json_object *results = json_tokener_parse(res);
+	if (!results) {
+		free(res);
+		return false;
+	}
+	bool visible = parse_workspaces(bar, results);
 	json_object_put(results);
 	free(res);
-	return determine_bar_visibility(bar, false);
+	return visible;
+}
+
+static void handle_workspaces_reply(struct ipc_response *resp, void *data) {
+	struct swaybar *bar = data;
+	bar->workspaces_pending = false;
+	json_object *results = json_tokener_parse(resp->payload);
+	if (!results) {
+		sway_log(SWAY_ERROR, "failed to parse payload as json");
+		return;
+	}
+	parse_workspaces(bar, results);
+	json_object_put(results);
+	set_bar_dirty(bar);
+}
+
+/**
+ * Ask for the workspaces on the event socket, so the main loop doesn't wait
+ * for them. The reply is handled in order with the events, which means it
+ * covers every event received before it.
+ */
+void ipc_request_workspaces(struct swaybar *bar) {
+	if (bar->workspaces_pending) {
+		return;
+	}
+	sway_log(SWAY_DEBUG, "Requesting workspaces");
+	ipc_client_send(bar->ipc_client, IPC_GET_WORKSPACES, NULL, 0,
+			handle_workspaces_reply, bar);
+	bar->workspaces_pending = true;
+}
+
+static struct swaybar_output *find_output(struct swaybar *bar,
+		json_object *ws_json) {
+	json_object *out;
+	json_object_object_get_ex(ws_json, "output", &out);
+	const char *name = json_object_get_string(out);
+	if (!name) {
+		return NULL;
+	}
+	struct swaybar_output *output;
+	wl_list_for_each(output, &bar->outputs, link) {
+		if (strcmp(name, output->name) == 0) {
+			return output;
+		}
+	}
+	return NULL;
+}
+
+static struct swaybar_workspace *find_workspace(struct swaybar *bar,
+		json_object *ws_json, struct swaybar_output **ws_output) {
+	json_object *json_id;
+	json_object_object_get_ex(ws_json, "id", &json_id);
+	int id = json_object_get_int(json_id);
+	struct swaybar_output *output;
+	wl_list_for_each(output, &bar->outputs, link) {
+		struct swaybar_workspace *ws;
+		wl_list_for_each(ws, &output->workspaces, link) {
+			if (ws->id == id) {
+				*ws_output = output;
+				return ws;
+			}
+		}
+	}
+	*ws_output = NULL;
+	return NULL;
+}
+
+static int workspace_cmp(struct swaybar_workspace *a,
+		struct swaybar_workspace *b) {
+	if (a->num != -1 && b->num != -1) {
+		return (a->num > b->num) - (a->num < b->num);
+	}
+	return (b->num != -1) - (a->num != -1);
+}
+
+/**
+ * Move the workspace to where sway's stable sort of the output's workspaces
+ * puts it, which keeps its place among those that compare equal.
+ */
+static void sort_workspace(struct swaybar_output *output,
+		struct swaybar_workspace *ws) {
+	struct wl_list *next = &output->workspaces;
+	bool after = false;
+	struct swaybar_workspace *other;
+	wl_list_for_each(other, &output->workspaces, link) {
+		if (other == ws) {
+			after = true;
+			continue;
+		}
+		int cmp = workspace_cmp(other, ws);
+		if (cmp > 0 || (cmp == 0 && after)) {
+			next = &other->link;
+			break;
+		}
+	}
+	wl_list_remove(&ws->link);
+	wl_list_insert(next->prev, &ws->link);
+}
+
+static bool handle_workspace_focus(struct swaybar *bar, json_object *current) {
+	struct swaybar_output *ws_output;
+	struct swaybar_workspace *focused =
+		find_workspace(bar, current, &ws_output);
+	if (!focused && find_output(bar, current)) {
+		ipc_request_workspaces(bar);
+		return false;
+	}
+
+	bool dirty = false;
+	struct swaybar_output *output;
+	wl_list_for_each(output, &bar->outputs, link) {
+		if (output->focused != (output == ws_output)) {
+			output->focused = output == ws_output;
+			dirty = true;
+		}
+		struct swaybar_workspace *ws;
+		wl_list_for_each(ws, &output->workspaces, link) {
+			bool visible = output == ws_output ? ws == focused : ws->visible;
+			if (ws->focused != (ws == focused) || ws->visible != visible) {
+				ws->focused = ws == focused;
+				ws->visible = visible;
+				dirty = true;
+			}
+		}
+	}
+	return dirty;
+}
+
+static bool handle_workspace_init(struct swaybar *bar, json_object *current) {
+	struct swaybar_output *output;
+	if (find_workspace(bar, current, &output)) {
+		return false;
+	}
+	output = find_output(bar, current);
+	if (!output) {
+		return false;
+	}
+	struct swaybar_workspace *ws = create_workspace(bar, current);
+	// An output always shows one workspace, so if this is its only one then
+	// it's visible. Otherwise a focus event follows if it should be.
+	ws->visible = wl_list_empty(&output->workspaces);
+	wl_list_insert(output->workspaces.prev, &ws->link);
+	sort_workspace(output, ws);
+	return true;
+}
+
+static bool handle_workspace_empty(struct swaybar *bar, json_object *current) {
+	struct swaybar_output *output;
+	struct swaybar_workspace *ws = find_workspace(bar, current, &output);
+	if (!ws) {
+		return false;
+	}
+	if (ws->visible) {
+		// Another workspace is shown in its place, without a focus event
+		ipc_request_workspaces(bar);
+	}
+	free_workspace(ws);
+	return true;
+}
+
+static bool handle_workspace_rename(struct swaybar *bar, json_object *current) {
+	struct swaybar_output *output;
+	struct swaybar_workspace *ws = find_workspace(bar, current, &output);
+	if (!ws) {
+		if (find_output(bar, current)) {
+			ipc_request_workspaces(bar);
+		}
+		return false;
+	}
+	json_object *num, *name;
+	json_object_object_get_ex(current, "num", &num);
+	json_object_object_get_ex(current, "name", &name);
+	workspace_set_name(bar, ws, json_object_get_string(name),
+			json_object_get_int(num));
+	sort_workspace(output, ws);
+	return true;
+}
+
+static bool handle_workspace_urgent(struct swaybar *bar, json_object *current) {
+	struct swaybar_output *output;
+	struct swaybar_workspace *ws = find_workspace(bar, current, &output);
+	if (!ws) {
+		return false;
+	}
+	json_object *urgent;
+	json_object_object_get_ex(current, "urgent", &urgent);
+	ws->urgent = json_object_get_boolean(urgent);
+
+	bool visible_by_urgency = false;
+	wl_list_for_each(output, &bar->outputs, link) {
+		wl_list_for_each(ws, &output->workspaces, link) {
+			visible_by_urgency |= ws->urgent;
+		}
+	}
+	if (visible_by_urgency != bar->visible_by_urgency) {
+		bar->visible_by_urgency = visible_by_urgency;
+		determine_bar_visibility(bar, false);
+	}
+	return true;
+}
+
+/**
+ * Apply a workspace event from its payload. Changes which can't be followed
+ * that way, such as a workspace moving to another output or a reload, request
+ * the workspaces again instead.
+ */
+static bool handle_workspace_event(struct swaybar *bar, json_object *event) {
+	json_object *json_change, *current;
+	if (!json_object_object_get_ex(event, "change", &json_change)) {
+		sway_log(SWAY_ERROR, "failed to parse workspace event");
+		return false;
+	}
+	const char *change = json_object_get_string(json_change);
+	json_object_object_get_ex(event, "current", &current);
+	if (!current) {
+		ipc_request_workspaces(bar);
+		return false;
+	}
+
+	if (strcmp(change, "focus") == 0) {
+		return handle_workspace_focus(bar, current);
+	} else if (strcmp(change, "init") == 0) {
+		return handle_workspace_init(bar, current);
+	} else if (strcmp(change, "empty") == 0) {
+		return handle_workspace_empty(bar, current);
+	} else if (strcmp(change, "rename") == 0) {
+		return handle_workspace_rename(bar, current);
+	} else if (strcmp(change, "urgent") == 0) {
+		return handle_workspace_urgent(bar, current);
+	}
+	ipc_request_workspaces(bar);
+	return false;
 }
 
 static void ipc_get_outputs(struct swaybar *bar) {
@@ -461,31 +714,8 @@ static void ipc_get_outputs(struct swaybar *bar) {
 void ipc_execute_binding(struct swaybar *bar, struct swaybar_binding *bind) {
 	sway_log(SWAY_DEBUG, "Executing binding for button %u (release=%d): `%s`",
 			bind->button, bind->release, bind->command);
-	uint32_t len = strlen(bind->command);
-	free(ipc_single_command(bar->ipc_socketfd,
-			IPC_COMMAND, bind->command, &len));
-}
-
-bool ipc_initialize(struct swaybar *bar) {
-	uint32_t len = strlen(bar->id);
-	char *res = ipc_single_command(bar->ipc_socketfd,
-			IPC_GET_BAR_CONFIG, bar->id, &len);
-	if (!ipc_parse_config(bar->config, res)) {
-		free(res);
-		return false;
-	}
-	free(res);
-	ipc_get_outputs(bar);
-
-	struct swaybar_config *config = bar->config;
-	char subscribe[128]; // suitably large buffer
-	len = snprintf(subscribe, 128,
-			"[ \"barconfig_update\" , \"bar_state_update\" %s %s ]",
-			config->binding_mode_indicator ? ", \"mode\"" : "",
-			config->workspace_buttons ? ", \"workspace\"" : "");
-	free(ipc_single_command(bar->ipc_event_socketfd,
-			IPC_SUBSCRIBE, subscribe, &len));
-	return true;
+	ipc_client_send(bar->ipc_client, IPC_COMMAND, bind->command,
+			strlen(bind->command), NULL, NULL);
 }
 
 static bool handle_bar_state_update(struct swaybar *bar, json_object *event) {
@@ -561,23 +791,24 @@ static bool handle_barconfig_update(struct swaybar *bar,
 	return determine_bar_visibility(bar, true);
 }
 
-bool handle_ipc_readable(struct swaybar *bar) {
-	struct ipc_response *resp = ipc_recv_response(bar->ipc_event_socketfd);
+static void handle_ipc_event(struct ipc_response *resp, void *data) {
+	struct swaybar *bar = data;
 	if (!resp) {
-		return false;
+		sway_log(SWAY_ERROR, "Lost the IPC connection to sway");
+		bar->running = false;
+		return;
 	}
 
 	json_object *result = json_tokener_parse(resp->payload);
 	if (!result) {
 		sway_log(SWAY_ERROR, "failed to parse payload as json");
-		free_ipc_response(resp);
-		return false;
+		return;
 	}
 
 	bool bar_is_dirty = true;
 	switch (resp->type) {
 	case IPC_EVENT_WORKSPACE:
-		bar_is_dirty = ipc_get_workspaces(bar);
+		bar_is_dirty = handle_workspace_event(bar, result);
 		break;
 	case IPC_EVENT_MODE: {
 		json_object *json_change, *json_pango_markup;
@@ -609,6 +840,32 @@ bool handle_ipc_readable(struct swaybar *bar) {
 		break;
 	}
 	json_object_put(result);
-	free_ipc_response(resp);
-	return bar_is_dirty;
+	if (bar_is_dirty) {
+		set_bar_dirty(bar);
+	}
+}
+
+bool ipc_initialize(struct swaybar *bar) {
+	uint32_t len = strlen(bar->id);
+	char *res = ipc_single_command(bar->ipc_socketfd,
+			IPC_GET_BAR_CONFIG, bar->id, &len);
+	if (!ipc_parse_config(bar->config, res)) {
+		free(res);
+		return false;
+	}
+	free(res);
+	ipc_get_outputs(bar);
+
+	struct swaybar_config *config = bar->config;
+	char subscribe[128]; // suitably large buffer
+	len = snprintf(subscribe, 128,
+			"[ \"barconfig_update\" , \"bar_state_update\" %s %s ]",
+			config->binding_mode_indicator ? ", \"mode\"" : "",
+			config->workspace_buttons ? ", \"workspace\"" : "");
+	free(ipc_single_command(bar->ipc_event_socketfd,
+			IPC_SUBSCRIBE, subscribe, &len));
+
+	bar->ipc_client = ipc_client_create(bar->ipc_event_socketfd,
+			bar->eventloop, handle_ipc_event, bar);
+	return bar->ipc_client != NULL;
 }
@@ -2,6 +2,7 @@
 #include <assert.h>
 #include <linux/input-event-codes.h>
 #include <limits.h>
+#include <math.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -14,6 +15,9 @@
 #include "swaybar/ipc.h"
 #include "swaybar/render.h"
 #include "swaybar/status_line.h"
+#include "hash.h"
+#include "list.h"
+#include "log.h"
 #if HAVE_TRAY
 #include "swaybar/tray/tray.h"
 #endif
@@ -23,6 +27,181 @@ static const int WS_HORIZONTAL_PADDING = 5;
 static const double WS_VERTICAL_PADDING = 1.5;
 static const double BORDER_WIDTH = 1;
 
+static uint32_t hash_u32(uint32_t hash, uint32_t value) {
+	return hash_bytes(hash, &value, sizeof(value));
+}
+
+static uint32_t hash_string(uint32_t hash, const char *str) {
+	if (!str) {
+		return hash_u32(hash, UINT32_MAX);
+	}
+	return hash_bytes(hash, str, strlen(str) + 1);
+}
+
+static void damage_add(struct swaybar_damage *damage, int x1, int x2) {
+	if (damage->whole || x1 >= x2) {
+		return;
+	}
+	// Merge with any range it touches
+	for (int i = 0; i < damage->length; ++i) {
+		if (x1 <= damage->ranges[i].x2 && damage->ranges[i].x1 <= x2) {
+			x1 = x1 < damage->ranges[i].x1 ? x1 : damage->ranges[i].x1;
+			x2 = x2 > damage->ranges[i].x2 ? x2 : damage->ranges[i].x2;
+			damage->ranges[i] = damage->ranges[--damage->length];
+			i = -1;
+		}
+	}
+	if (damage->length == SWAYBAR_DAMAGE_RANGES) {
+		// Out of ranges, so merge with the closest one
+		int closest = 0, closest_gap = INT_MAX;
+		for (int i = 0; i < damage->length; ++i) {
+			int gap = x1 > damage->ranges[i].x2 ?
+				x1 - damage->ranges[i].x2 : damage->ranges[i].x1 - x2;
+			if (gap < closest_gap) {
+				closest = i;
+				closest_gap = gap;
+			}
+		}
+		x1 = x1 < damage->ranges[closest].x1 ? x1 : damage->ranges[closest].x1;
+		x2 = x2 > damage->ranges[closest].x2 ? x2 : damage->ranges[closest].x2;
+		damage->ranges[closest] = damage->ranges[--damage->length];
+		damage_add(damage, x1, x2);
+		return;
+	}
+	damage->ranges[damage->length].x1 = x1;
+	damage->ranges[damage->length].x2 = x2;
+	damage->length++;
+}
+
+static void damage_merge(struct swaybar_damage *dst,
+		const struct swaybar_damage *src) {
+	if (src->whole) {
+		dst->whole = true;
+		dst->length = 0;
+		return;
+	}
+	for (int i = 0; i < src->length; ++i) {
+		damage_add(dst, src->ranges[i].x1, src->ranges[i].x2);
+	}
+}
+
+static void damage_clear(struct swaybar_damage *damage) {
+	damage->whole = false;
+	damage->length = 0;
+}
+
+/**
+ * Record a region drawn in this frame, which spans the full height of the bar.
+ * Unless the same region was drawn at the same place in the last frame, it's
+ * damaged.
+ */
+static void add_region(struct swaybar_output *output, double x, double width,
+		uint32_t hash) {
+	if (width <= 0) {
+		return;
+	}
+	bool matched = false;
+	for (int i = 0; i < output->regions->length && !matched; ++i) {
+		struct swaybar_region *old = output->regions->items[i];
+		if (!old->matched && old->x == x && old->width == width &&
+				old->hash == hash) {
+			old->matched = matched = true;
+		}
+	}
+	if (!matched) {
+		damage_add(&output->frame_damage, floor(x), ceil(x + width));
+	}
+
+	struct swaybar_region *region = calloc(1, sizeof(struct swaybar_region));
+	if (!region) {
+		sway_log(SWAY_ERROR, "Unable to allocate bar region");
+		output->frame_damage.whole = true;
+		return;
+	}
+	region->x = x;
+	region->width = width;
+	region->hash = hash;
+	list_add(output->new_regions, region);
+}
+
+/**
+ * The status line is drawn the same way on every output with the same scale,
+ * subpixel order, height and focus, given the same space. So it's measured and
+ * rasterized once into an image which those outputs share. The regions and
+ * hotspots of its blocks are kept relative to its right edge.
+ */
+#define STATUS_RENDERS_MAX 8
+
+struct status_render_region {
+	double x, width; // relative to the right edge of the status line
+	uint32_t hash;
+	// The block which gets a hotspot, and the width of its hotspot
+	struct i3bar_block *block;
+	double hotspot_width;
+};
+
+struct status_render {
+	uint32_t content_hash;
+	int32_t scale;
+	enum wl_output_subpixel subpixel;
+	uint32_t height;
+	bool focused, edge, short_text;
+
+	cairo_surface_t *image; // NULL if nothing was drawn
+	double width; // of the status line, in buffer-local pixels
+	uint32_t ideal_height;
+	list_t *regions; // struct status_render_region
+};
+
+static void status_render_add_region(struct status_render *render,
+		double x, double width, uint32_t hash, struct i3bar_block *block,
+		double hotspot_width) {
+	struct status_render_region *region =
+		calloc(1, sizeof(struct status_render_region));
+	if (!region) {
+		sway_log(SWAY_ERROR, "Unable to allocate status region");
+		return;
+	}
+	region->x = x;
+	region->width = width;
+	region->hash = hash;
+	if (block) {
+		region->block = block;
+		region->hotspot_width = hotspot_width;
+		block->ref_count++;
+	}
+	list_add(render->regions, region);
+}
+
+static void status_render_destroy(struct status_render *render) {
+	for (int i = 0; i < render->regions->length; ++i) {
+		struct status_render_region *region = render->regions->items[i];
+		i3bar_block_unref(region->block);
+		free(region);
+	}
+	list_free(render->regions);
+	if (render->image) {
+		cairo_surface_destroy(render->image);
+	}
+	free(render);
+}
+
+void destroy_status_renders(struct swaybar *bar) {
+	for (int i = 0; i < bar->status_renders->length; ++i) {
+		status_render_destroy(bar->status_renders->items[i]);
+	}
+	list_free(bar->status_renders);
+	bar->status_renders = NULL;
+}
+
+static uint32_t hash_status_block(struct i3bar_block *block, bool edge,
+		bool use_short_text) {
+	uint32_t hash = hash_u32(HASH_SEED, edge);
+	hash = hash_u32(hash, use_short_text);
+	hash = hash_u32(hash, block->serial);
+	return hash;
+}
+
 static uint32_t render_status_line_error(cairo_t *cairo,
 		struct swaybar_output *output, double *x) {
 	const char *error = output->bar->status->text;
@@ -143,11 +322,12 @@ static void i3bar_block_unref_callback(void *data) {
 }
 
 static uint32_t render_status_block(cairo_t *cairo,
-		struct swaybar_output *output, struct i3bar_block *block, double *x,
-		bool edge, bool use_short_text) {
+		struct swaybar_output *output, struct status_render *render,
+		struct i3bar_block *block, double *x, bool edge, bool use_short_text) {
 	if (!block->full_text || !*block->full_text) {
 		return 0;
 	}
+	double end = *x;
 
 	char* text = block->full_text;
 	if (use_short_text && block->short_text && *block->short_text) {
@@ -214,18 +394,8 @@ static uint32_t render_status_block(cairo_t *cairo,
 	}
 
 	uint32_t height = output->height * output->scale;
-	if (output->bar->status->click_events) {
-		struct swaybar_hotspot *hotspot = calloc(1, sizeof(struct swaybar_hotspot));
-		hotspot->x = *x;
-		hotspot->y = 0;
-		hotspot->width = width;
-		hotspot->height = height;
-		hotspot->callback = block_hotspot_callback;
-		hotspot->destroy = i3bar_block_unref_callback;
-		hotspot->data = block;
-		block->ref_count++;
-		wl_list_insert(&output->hotspots, &hotspot->link);
-	}
+	status_render_add_region(render, *x, end - *x,
+			hash_status_block(block, edge, use_short_text), block, width);
 
 	double x_pos = *x;
 	double y_pos = ws_vertical_padding;
@@ -299,85 +469,6 @@ static uint32_t render_status_block(cairo_t *cairo,
 	return output->height;
 }
 
-static void predict_status_block_pos(cairo_t *cairo,
-		struct swaybar_output *output, struct i3bar_block *block, double *x,
-		bool edge) {
-	if (!block->full_text || !*block->full_text) {
-		return;
-	}
-
-	struct swaybar_config *config = output->bar->config;
-
-	int text_width, text_height;
-	get_text_size(cairo, config->font, &text_width, &text_height, NULL,
-			output->scale, block->markup, "%s", block->full_text);
-
-	int margin = 3 * output->scale;
-	double ws_vertical_padding = config->status_padding * output->scale;
-
-	int width = text_width;
-
-	if (block->min_width_str) {
-		int w;
-		get_text_size(cairo, config->font, &w, NULL, NULL,
-				output->scale, block->markup, "%s", block->min_width_str);
-		block->min_width = w;
-	}
-	if (width < block->min_width) {
-		width = block->min_width;
-	}
-
-	double block_width = width;
-	uint32_t ideal_height = text_height + ws_vertical_padding * 2;
-	uint32_t ideal_surface_height = ideal_height / output->scale;
-	if (!output->bar->config->height &&
-			output->height < ideal_surface_height) {
-		return;
-	}
-
-	*x -= width;
-	if ((block->border || block->urgent) && block->border_left > 0) {
-		*x -= (block->border_left * output->scale + margin);
-		block_width += block->border_left * output->scale + margin;
-	}
-	if ((block->border || block->urgent) && block->border_right > 0) {
-		*x -= (block->border_right * output->scale + margin);
-		block_width += block->border_right * output->scale + margin;
-	}
-
-	int sep_width, sep_height;
-	int sep_block_width = block->separator_block_width;
-	if (!edge) {
-		if (config->sep_symbol) {
-			get_text_size(cairo, config->font, &sep_width, &sep_height, NULL,
-					output->scale, false, "%s", config->sep_symbol);
-			uint32_t _ideal_height = sep_height + ws_vertical_padding * 2;
-			uint32_t _ideal_surface_height = _ideal_height / output->scale;
-			if (!output->bar->config->height &&
-					output->height < _ideal_surface_height) {
-				return;
-			}
-			if (sep_width > sep_block_width) {
-				sep_block_width = sep_width + margin * 2;
-			}
-		}
-		*x -= sep_block_width;
-	} else if (config->status_edge_padding) {
-		*x -= config->status_edge_padding * output->scale;
-	}
-}
-
-static double predict_status_line_pos(cairo_t *cairo,
-		struct swaybar_output *output, double x) {
-	bool edge = x == output->width * output->scale;
-	struct i3bar_block *block;
-	wl_list_for_each(block, &output->bar->status->blocks, link) {
-		predict_status_block_pos(cairo, output, block, &x, edge);
-		edge = false;
-	}
-	return x;
-}
-
 static uint32_t predict_workspace_button_length(cairo_t *cairo,
 		struct swaybar_output *output,
 		struct swaybar_workspace *ws) {
@@ -447,47 +538,185 @@ static uint32_t predict_binding_mode_indicator_length(cairo_t *cairo,
 }
 
 static uint32_t render_status_line_i3bar(cairo_t *cairo,
-		struct swaybar_output *output, double *x) {
+		struct swaybar_output *output, struct status_render *render,
+		double *x) {
 	uint32_t max_height = 0;
-	bool edge = *x == output->width * output->scale;
+	bool edge = render->edge;
 	struct i3bar_block *block;
-	bool use_short_text = false;
-
-	double reserved_width =
-			predict_workspace_buttons_length(cairo, output) +
-			predict_binding_mode_indicator_length(cairo, output) +
-			3 * output->scale; // require a bit of space for margin
-
-	double predicted_full_pos =
-			predict_status_line_pos(cairo, output, *x);
-
-	if (predicted_full_pos < reserved_width) {
-		use_short_text = true;
-	}
-
 	wl_list_for_each(block, &output->bar->status->blocks, link) {
-		uint32_t h = render_status_block(cairo, output, block, x, edge,
-					use_short_text);
+		uint32_t h = render_status_block(cairo, output, render, block, x,
+				edge, render->short_text);
 		max_height = h > max_height ? h : max_height;
 		edge = false;
 	}
 	return max_height;
 }
 
-static uint32_t render_status_line(cairo_t *cairo,
-		struct swaybar_output *output, double *x) {
+static void set_font_options(cairo_t *cairo, enum wl_output_subpixel subpixel) {
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+	cairo_font_options_t *fo = cairo_font_options_create();
+	cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
+	cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
+	cairo_font_options_set_subpixel_order(fo, to_cairo_subpixel_order(subpixel));
+	cairo_set_font_options(cairo, fo);
+	cairo_font_options_destroy(fo);
+}
+
+/**
+ * Draw the status line leftwards from x = 0, recording its regions, then
+ * rasterize it on top of the bar's background.
+ */
+static void draw_status_render(struct status_render *render,
+		struct swaybar_output *output) {
 	struct status_line *status = output->bar->status;
+	struct swaybar_config *config = output->bar->config;
+	uint32_t background = render->focused ?
+		config->colors.focused_background : config->colors.background;
+
+	cairo_surface_t *recorder = cairo_recording_surface_create(
+			CAIRO_CONTENT_COLOR_ALPHA, NULL);
+	cairo_t *cairo = cairo_create(recorder);
+	set_font_options(cairo, render->subpixel);
+	cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_u32(cairo, background);
+	cairo_paint(cairo);
+
+	double x = 0;
 	switch (status->protocol) {
 	case PROTOCOL_ERROR:
-		return render_status_line_error(cairo, output, x);
+		render->ideal_height = render_status_line_error(cairo, output, &x);
+		status_render_add_region(render, x, -x,
+				hash_string(HASH_SEED, status->text), NULL, 0);
+		break;
 	case PROTOCOL_TEXT:
-		return render_status_line_text(cairo, output, x);
+		render->ideal_height = render_status_line_text(cairo, output, &x);
+		status_render_add_region(render, x, -x,
+				hash_string(HASH_SEED, status->text), NULL, 0);
+		break;
 	case PROTOCOL_I3BAR:
-		return render_status_line_i3bar(cairo, output, x);
+		render->ideal_height =
+			render_status_line_i3bar(cairo, output, render, &x);
+		break;
 	case PROTOCOL_UNDEF:
+		break;
+	}
+	render->width = -x;
+
+	int width = ceil(render->width);
+	int height = render->height * render->scale;
+	if (width > 0 && height > 0) {
+		render->image =
+			cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+		cairo_t *image = cairo_create(render->image);
+		cairo_set_source_surface(image, recorder, width, 0);
+		cairo_paint(image);
+		cairo_destroy(image);
+	}
+	cairo_destroy(cairo);
+	cairo_surface_destroy(recorder);
+}
+
+static uint32_t hash_status(struct status_line *status) {
+	uint32_t hash = hash_u32(HASH_SEED, status->protocol);
+	if (status->protocol != PROTOCOL_I3BAR) {
+		return hash_string(hash, status->text);
+	}
+	struct i3bar_block *block;
+	wl_list_for_each(block, &status->blocks, link) {
+		hash = hash_u32(hash, block->serial);
+	}
+	return hash;
+}
+
+static struct status_render *get_status_render(struct swaybar_output *output,
+		bool edge, bool short_text) {
+	list_t *renders = output->bar->status_renders;
+	uint32_t content_hash = hash_status(output->bar->status);
+	for (int i = 0; i < renders->length; ++i) {
+		struct status_render *render = renders->items[i];
+		if (render->content_hash != content_hash) {
+			status_render_destroy(render);
+			list_del(renders, i--);
+			continue;
+		}
+		if (render->scale == output->scale &&
+				render->subpixel == output->subpixel &&
+				render->height == output->height &&
+				render->focused == output->focused &&
+				render->edge == edge && render->short_text == short_text) {
+			return render;
+		}
+	}
+
+	struct status_render *render = calloc(1, sizeof(struct status_render));
+	if (!render) {
+		sway_log(SWAY_ERROR, "Unable to allocate status render");
+		return NULL;
+	}
+	render->content_hash = content_hash;
+	render->scale = output->scale;
+	render->subpixel = output->subpixel;
+	render->height = output->height;
+	render->focused = output->focused;
+	render->edge = edge;
+	render->short_text = short_text;
+	render->regions = create_list();
+	draw_status_render(render, output);
+
+	if (renders->length == STATUS_RENDERS_MAX) {
+		status_render_destroy(renders->items[renders->length - 1]);
+		list_del(renders, renders->length - 1);
+	}
+	list_insert(renders, 0, render);
+	return render;
+}
+
+static uint32_t render_status_line(cairo_t *cairo,
+		struct swaybar_output *output, double *x) {
+	struct status_line *status = output->bar->status;
+	bool edge = *x == output->width * output->scale;
+	struct status_render *render = get_status_render(output, edge, false);
+	if (render && status->protocol == PROTOCOL_I3BAR) {
+		double reserved_width =
+			predict_workspace_buttons_length(cairo, output) +
+			predict_binding_mode_indicator_length(cairo, output) +
+			3 * output->scale; // require a bit of space for margin
+		if (*x - render->width < reserved_width) {
+			render = get_status_render(output, edge, true);
+		}
+	}
+	if (!render) {
 		return 0;
 	}
-	return 0;
+
+	if (render->image) {
+		int width = cairo_image_surface_get_width(render->image);
+		int height = cairo_image_surface_get_height(render->image);
+		cairo_set_source_surface(cairo, render->image, *x - width, 0);
+		cairo_rectangle(cairo, *x - width, 0, width, height);
+		cairo_fill(cairo);
+	}
+
+	for (int i = 0; i < render->regions->length; ++i) {
+		struct status_render_region *region = render->regions->items[i];
+		add_region(output, *x + region->x, region->width, region->hash);
+		if (!region->block || !status->click_events) {
+			continue;
+		}
+		struct swaybar_hotspot *hotspot =
+			calloc(1, sizeof(struct swaybar_hotspot));
+		hotspot->x = *x + region->x;
+		hotspot->y = 0;
+		hotspot->width = region->hotspot_width;
+		hotspot->height = output->height * output->scale;
+		hotspot->callback = block_hotspot_callback;
+		hotspot->destroy = i3bar_block_unref_callback;
+		hotspot->data = region->block;
+		region->block->ref_count++;
+		wl_list_insert(&output->hotspots, &hotspot->link);
+	}
+	*x -= render->width;
+	return render->ideal_height;
 }
 
 static uint32_t render_binding_mode_indicator(cairo_t *cairo,
@@ -536,6 +765,10 @@ static uint32_t render_binding_mode_indicator(cairo_t *cairo,
 	cairo_move_to(cairo, x + width / 2 - text_width / 2, (int)floor(text_y));
 	pango_printf(cairo, config->font, output->scale,
 			output->bar->mode_pango_markup, "%s", mode);
+
+	uint32_t hash = hash_string(HASH_SEED, mode);
+	hash = hash_u32(hash, output->bar->mode_pango_markup);
+	add_region(output, x, width, hash);
 	return output->height;
 }
 
@@ -614,6 +847,10 @@ static uint32_t render_workspace_button(cairo_t *cairo,
 	hotspot->data = strdup(ws->name);
 	wl_list_insert(&output->hotspots, &hotspot->link);
 
+	uint32_t hash = hash_string(HASH_SEED, ws->label);
+	hash = hash_bytes(hash, &box_colors, sizeof(box_colors));
+	add_region(output, *x, width, hash);
+
 	*x += width;
 	return output->height;
 }
@@ -642,8 +879,15 @@ static uint32_t render_to_cairo(cairo_t *cairo, struct swaybar_output *output) {
 	double x = output->width * output->scale;
 #if HAVE_TRAY
 	if (bar->tray) {
+		double end = x;
 		uint32_t h = render_tray(cairo, output, &x);
 		max_height = h > max_height ? h : max_height;
+
+		uint32_t hash = hash_u32(HASH_SEED, bar->tray->serial);
+		hash = hash_u32(hash, bar->tray->items->length);
+		hash = hash_u32(hash, config->tray_padding);
+		hash = hash_string(hash, config->icon_theme);
+		add_region(output, x, end - x, hash);
 	}
 #endif
 	if (bar->status) {
@@ -681,6 +925,75 @@ static const struct wl_callback_listener output_frame_listener = {
 	.done = output_frame_handle_done
 };
 
+/**
+ * Hash everything that isn't part of a region but affects the whole bar. When
+ * it changes, all of the bar is damaged.
+ */
+static uint32_t hash_frame(struct swaybar_output *output, uint32_t height) {
+	struct swaybar_config *config = output->bar->config;
+	uint32_t hash = hash_u32(HASH_SEED, output->width);
+	hash = hash_u32(hash, height);
+	hash = hash_u32(hash, output->scale);
+	hash = hash_u32(hash, output->subpixel);
+	hash = hash_u32(hash, output->focused);
+	hash = hash_string(hash, config->font);
+	hash = hash_string(hash, config->sep_symbol);
+	hash = hash_u32(hash, config->pango_markup);
+	hash = hash_u32(hash, config->status_padding);
+	hash = hash_u32(hash, config->status_edge_padding);
+	hash = hash_bytes(hash, &config->colors, sizeof(config->colors));
+	return hash;
+}
+
+/**
+ * Work out the damage of the frame which was just rendered: the regions which
+ * weren't drawn the same way in the last frame, those which went away, or all
+ * of it if anything shared by the whole bar changed.
+ */
+static void finish_regions(struct swaybar_output *output, uint32_t height) {
+	uint32_t frame_hash = hash_frame(output, height);
+	if (frame_hash != output->frame_hash) {
+		output->frame_damage.whole = true;
+		output->frame_hash = frame_hash;
+	}
+	for (int i = 0; i < output->regions->length; ++i) {
+		struct swaybar_region *old = output->regions->items[i];
+		if (!old->matched) {
+			damage_add(&output->frame_damage,
+					floor(old->x), ceil(old->x + old->width));
+		}
+	}
+	list_free_items_and_destroy(output->regions);
+	output->regions = output->new_regions;
+	output->new_regions = NULL;
+}
+
+static void damage_surface(struct swaybar_output *output,
+		struct swaybar_damage *damage) {
+	if (damage->whole) {
+		wl_surface_damage(output->surface, 0, 0,
+				output->width, output->height);
+		return;
+	}
+	for (int i = 0; i < damage->length; ++i) {
+		int x1 = damage->ranges[i].x1 / output->scale;
+		int x2 = (damage->ranges[i].x2 + output->scale - 1) / output->scale;
+		wl_surface_damage(output->surface, x1, 0, x2 - x1, output->height);
+	}
+}
+
+static void clip_to_damage(cairo_t *cairo, struct swaybar_damage *damage,
+		uint32_t height) {
+	if (damage->whole) {
+		return;
+	}
+	for (int i = 0; i < damage->length; ++i) {
+		cairo_rectangle(cairo, damage->ranges[i].x1, 0,
+				damage->ranges[i].x2 - damage->ranges[i].x1, height);
+	}
+	cairo_clip(cairo);
+}
+
 void render_frame(struct swaybar_output *output) {
 	assert(output->surface != NULL);
 	if (!output->layer_surface) {
@@ -688,17 +1001,16 @@ void render_frame(struct swaybar_output *output) {
 	}
 
 	free_hotspots(&output->hotspots);
+	output->new_regions = create_list();
+	damage_clear(&output->frame_damage);
 
+	// All of the bar is recorded, since that's what works out the regions and
+	// their hashes, but recording is cheap next to rasterizing: only the
+	// damaged columns of the recording are replayed into the buffer below
 	cairo_surface_t *recorder = cairo_recording_surface_create(
 			CAIRO_CONTENT_COLOR_ALPHA, NULL);
 	cairo_t *cairo = cairo_create(recorder);
-	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
-	cairo_font_options_t *fo = cairo_font_options_create();
-	cairo_font_options_set_hint_style(fo, CAIRO_HINT_STYLE_FULL);
-	cairo_font_options_set_antialias(fo, CAIRO_ANTIALIAS_SUBPIXEL);
-	cairo_font_options_set_subpixel_order(fo, to_cairo_subpixel_order(output->subpixel));
-	cairo_set_font_options(cairo, fo);
-	cairo_font_options_destroy(fo);
+	set_font_options(cairo, output->subpixel);
 	cairo_save(cairo);
 	cairo_set_operator(cairo, CAIRO_OPERATOR_CLEAR);
 	cairo_paint(cairo);
@@ -708,6 +1020,11 @@ void render_frame(struct swaybar_output *output) {
 	if (config_height > 0) {
 		height = config_height;
 	}
+	finish_regions(output, height);
+	damage_merge(&output->surface_damage, &output->frame_damage);
+	for (size_t i = 0; i < output->buffers.length; ++i) {
+		damage_merge(&output->buffer_damage[i], &output->frame_damage);
+	}
 	if (height != output->height || output->width == 0) {
 		// Reconfigure surface
 		zwlr_layer_surface_v1_set_size(output->layer_surface, 0, height);
@@ -722,10 +1039,20 @@ void render_frame(struct swaybar_output *output) {
 		// TODO: this could infinite loop if the compositor assigns us a
 		// different height than what we asked for
 		wl_surface_commit(output->surface);
+		// The bar will be redrawn in full at the new size
+		output->frame_hash = 0;
 	} else if (height > 0) {
-		// Replay recording into shm and send it off
+		if (!output->surface_damage.whole &&
+				output->surface_damage.length == 0) {
+			// Nothing changed
+			cairo_surface_destroy(recorder);
+			cairo_destroy(cairo);
+			return;
+		}
+
+		// Replay the damaged parts of the recording into shm and send it off
 		output->current_buffer = get_next_buffer(output->bar->shm,
-				output->buffers,
+				&output->buffers,
 				output->width * output->scale,
 				output->height * output->scale);
 		if (!output->current_buffer) {
@@ -734,7 +1061,11 @@ void render_frame(struct swaybar_output *output) {
 			return;
 		}
 		cairo_t *shm = output->current_buffer->cairo;
+		size_t index = output->current_buffer - output->buffers.buffers;
+		struct swaybar_damage *buffer_damage = &output->buffer_damage[index];
 
+		cairo_save(shm);
+		clip_to_damage(shm, buffer_damage, output->height * output->scale);
 		cairo_save(shm);
 		cairo_set_operator(shm, CAIRO_OPERATOR_CLEAR);
 		cairo_paint(shm);
@@ -742,12 +1073,14 @@ void render_frame(struct swaybar_output *output) {
 
 		cairo_set_source_surface(shm, recorder, 0.0, 0.0);
 		cairo_paint(shm);
+		cairo_restore(shm);
+		damage_clear(buffer_damage);
 
 		wl_surface_set_buffer_scale(output->surface, output->scale);
 		wl_surface_attach(output->surface,
 				output->current_buffer->buffer, 0, 0);
-		wl_surface_damage(output->surface, 0, 0,
-				output->width, output->height);
+		damage_surface(output, &output->surface_damage);
+		damage_clear(&output->surface_damage);
 
 		struct wl_callback *frame_callback = wl_surface_frame(output->surface);
 		wl_callback_add_listener(frame_callback, &output_frame_listener, output);
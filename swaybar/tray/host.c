@@ -25,6 +25,7 @@ static void add_sni(struct swaybar_tray *tray, char *id) {
 		struct swaybar_sni *sni = create_sni(id, tray);
 		if (sni) {
 			list_add(tray->items, sni);
+			tray->serial++;
 		}
 	}
 }
@@ -57,6 +58,7 @@ static int handle_sni_unregistered(sd_bus_message *msg, void *data,
 		sway_log(SWAY_INFO, "Unregistering Status Notifier Item '%s'", id);
 		destroy_sni(tray->items->items[idx]);
 		list_del(tray->items, idx);
+		tray->serial++;
 		set_bar_dirty(tray->bar);
 	}
 	return ret;
@@ -6,14 +6,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include <wordexp.h>
 #include "swaybar/tray/icon.h"
 #include "config.h"
+#include "hash.h"
 #include "list.h"
 #include "log.h"
 #include "stringop.h"
 
+static const char *extensions[] = {
+#if HAVE_GDK_PIXBUF
+	"svg",
+#endif
+	"png",
+#if HAVE_GDK_PIXBUF
+	"xpm"
+#endif
+};
+
+/**
+ * Where a theme has an icon: the base directory, subdirectory and extension,
+ * as indices into the basedirs, the theme's subdirs and extensions.
+ */
+struct icon_location {
+	int basedir;
+	int subdir;
+	int extension;
+};
+
+// Seconds between checks for changes to an indexed theme, on a missed lookup
+#define THEME_CHECK_INTERVAL 5
+
 static bool dir_exists(char *path) {
 	struct stat sb;
 	return stat(path, &sb) == 0 && S_ISDIR(sb.st_mode);
@@ -59,10 +84,27 @@ static list_t *get_basedirs(void) {
 	return basedirs_expanded;
 }
 
+static void destroy_icon_locations(const void *name, void *locations,
+		void *data) {
+	free((char *)name);
+	list_free_items_and_destroy(locations);
+}
+
+static void unindex_theme(struct icon_theme *theme) {
+	if (theme->icons) {
+		hash_for_each(theme->icons, destroy_icon_locations, NULL);
+		hash_free(theme->icons);
+	}
+	free(theme->dir_mtimes);
+	theme->icons = NULL;
+	theme->dir_mtimes = NULL;
+}
+
 static void destroy_theme(struct icon_theme *theme) {
 	if (!theme) {
 		return;
 	}
+	unindex_theme(theme);
 	free(theme->name);
 	free(theme->comment);
 	free(theme->inherits);
@@ -372,16 +414,6 @@ void finish_themes(list_t *themes, list_t *basedirs) {
 
 static char *find_icon_in_subdir(char *name, char *basedir, char *theme,
 		char *subdir) {
-	static const char *extensions[] = {
-#if HAVE_GDK_PIXBUF
-		"svg",
-#endif
-		"png",
-#if HAVE_GDK_PIXBUF
-		"xpm"
-#endif
-	};
-
 	size_t path_len = snprintf(NULL, 0, "%s/%s/%s/%s.EXT", basedir, theme,
 			subdir, name) + 1;
 	char *path = malloc(path_len);
@@ -398,13 +430,145 @@ static char *find_icon_in_subdir(char *name, char *basedir, char *theme,
 	return NULL;
 }
 
-static bool theme_exists_in_basedir(char *theme, char *basedir) {
-	size_t path_len = snprintf(NULL, 0, "%s/%s", basedir, theme) + 1;
+static int find_extension(const char *extension) {
+	for (size_t i = 0; i < sizeof(extensions) / sizeof(*extensions); ++i) {
+		if (strcmp(extension, extensions[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static char *get_subdir_path(struct icon_theme *theme, char *basedir,
+		struct icon_theme_subdir *subdir) {
+	size_t path_len = snprintf(NULL, 0, "%s/%s/%s",
+			basedir, theme->dir, subdir->name) + 1;
 	char *path = malloc(path_len);
-	snprintf(path, path_len, "%s/%s", basedir, theme);
-	bool ret = dir_exists(path);
-	free(path);
-	return ret;
+	if (path) {
+		snprintf(path, path_len, "%s/%s/%s", basedir, theme->dir, subdir->name);
+	}
+	return path;
+}
+
+static void get_dir_mtime(const char *path, struct timespec *mtime) {
+	struct stat sb;
+	if (path && stat(path, &sb) == 0) {
+		*mtime = sb.st_mtim;
+	} else {
+		mtime->tv_sec = mtime->tv_nsec = 0;
+	}
+}
+
+/**
+ * List the icons in each of the theme's subdirectories, so that looking one up
+ * doesn't need to probe the file system for every subdirectory and extension.
+ */
+static void index_theme(struct icon_theme *theme, list_t *basedirs) {
+	theme->icons = create_hash(hash_str, hash_str_equal);
+	theme->dir_mtimes = calloc(basedirs->length * theme->subdirs->length,
+			sizeof(struct timespec));
+	theme->checked = time(NULL);
+	for (int i = 0; i < basedirs->length; ++i) {
+		for (int j = 0; j < theme->subdirs->length; ++j) {
+			char *path = get_subdir_path(theme, basedirs->items[i],
+					theme->subdirs->items[j]);
+			if (!path) {
+				continue;
+			}
+			// Taken before reading, so later changes are noticed
+			if (theme->dir_mtimes) {
+				get_dir_mtime(path,
+						&theme->dir_mtimes[i * theme->subdirs->length + j]);
+			}
+			DIR *dir = opendir(path);
+			free(path);
+			if (!dir) {
+				continue;
+			}
+
+			struct dirent *entry;
+			while ((entry = readdir(dir))) {
+				char *dot = strrchr(entry->d_name, '.');
+				if (!dot || dot == entry->d_name) {
+					continue;
+				}
+				int extension = find_extension(dot + 1);
+				if (extension == -1) {
+					continue;
+				}
+				// Such as broken symlinks
+				if (faccessat(dirfd(dir), entry->d_name, R_OK, 0) != 0) {
+					continue;
+				}
+				struct icon_location *location =
+					malloc(sizeof(struct icon_location));
+				if (!location) {
+					continue;
+				}
+				location->basedir = i;
+				location->subdir = j;
+				location->extension = extension;
+
+				char *name = strndup(entry->d_name, dot - entry->d_name);
+				list_t *locations = hash_get(theme->icons, name);
+				if (locations) {
+					free(name);
+				} else {
+					locations = create_list();
+					hash_set(theme->icons, name, locations);
+				}
+				list_add(locations, location);
+			}
+			closedir(dir);
+		}
+	}
+	sway_log(SWAY_DEBUG, "Indexed %d icons in theme %s",
+			theme->icons->length, theme->name);
+}
+
+/**
+ * Whether any of the theme's directories changed since it was indexed. Only
+ * checked every THEME_CHECK_INTERVAL seconds, since it means a stat for each
+ * basedir and subdir pair.
+ */
+static bool theme_changed(struct icon_theme *theme, list_t *basedirs) {
+	time_t now = time(NULL);
+	if (!theme->dir_mtimes || now - theme->checked < THEME_CHECK_INTERVAL) {
+		return false;
+	}
+	theme->checked = now;
+	for (int i = 0; i < basedirs->length; ++i) {
+		for (int j = 0; j < theme->subdirs->length; ++j) {
+			char *path = get_subdir_path(theme, basedirs->items[i],
+					theme->subdirs->items[j]);
+			struct timespec mtime;
+			get_dir_mtime(path, &mtime);
+			free(path);
+			struct timespec *indexed =
+				&theme->dir_mtimes[i * theme->subdirs->length + j];
+			if (mtime.tv_sec != indexed->tv_sec ||
+					mtime.tv_nsec != indexed->tv_nsec) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * Whether a is searched before b: base directories in order, subdirectories
+ * backwards to hopefully hit scalable/larger icons first, then extensions in
+ * order of preference.
+ */
+static bool location_precedes(struct icon_location *a,
+		struct icon_location *b) {
+	if (a->basedir != b->basedir) {
+		return a->basedir < b->basedir;
+	}
+	if (a->subdir != b->subdir) {
+		return a->subdir > b->subdir;
+	}
+	return a->extension < b->extension;
 }
 
 static char *find_icon_with_theme(list_t *basedirs, list_t *themes, char *name,
@@ -419,53 +583,53 @@ static char *find_icon_with_theme(list_t *basedirs, list_t *themes, char *name,
 	}
 	if (!theme) return NULL;
 
-	char *icon = NULL;
-	for (int i = 0; i < basedirs->length; ++i) {
-		if (!theme_exists_in_basedir(theme->dir, basedirs->items[i])) {
-			continue;
-		}
-		// search backwards to hopefully hit scalable/larger icons first
-		for (int j = theme->subdirs->length - 1; j >= 0; --j) {
-			struct icon_theme_subdir *subdir = theme->subdirs->items[j];
-			if (size >= subdir->min_size && size <= subdir->max_size) {
-				if ((icon = find_icon_in_subdir(name, basedirs->items[i],
-								theme->dir, subdir->name))) {
-					*min_size = subdir->min_size;
-					*max_size = subdir->max_size;
-					return icon;
-				}
-			}
-		}
+	if (!theme->icons) {
+		index_theme(theme, basedirs);
+	}
+	list_t *locations = hash_get(theme->icons, name);
+	if (!locations && theme_changed(theme, basedirs)) {
+		// Icons may have been installed since
+		sway_log(SWAY_DEBUG, "Theme %s changed, indexing it again",
+				theme->name);
+		unindex_theme(theme);
+		index_theme(theme, basedirs);
+		locations = hash_get(theme->icons, name);
 	}
 
-	// inexact match
+	// Prefer an exact match, otherwise the one with the smallest size error
+	struct icon_location *best = NULL;
 	unsigned smallest_error = -1; // UINT_MAX
-	for (int i = 0; i < basedirs->length; ++i) {
-		if (!theme_exists_in_basedir(theme->dir, basedirs->items[i])) {
-			continue;
-		}
-		for (int j = theme->subdirs->length - 1; j >= 0; --j) {
-			struct icon_theme_subdir *subdir = theme->subdirs->items[j];
-			unsigned error = (size > subdir->max_size ? size - subdir->max_size : 0)
-				+ (size < subdir->min_size ? subdir->min_size - size : 0);
-			if (error < smallest_error) {
-				char *test_icon = find_icon_in_subdir(name, basedirs->items[i],
-						theme->dir, subdir->name);
-				if (test_icon) {
-					icon = test_icon;
-					smallest_error = error;
-					*min_size = subdir->min_size;
-					*max_size = subdir->max_size;
-				}
-			}
+	for (int i = 0; locations && i < locations->length; ++i) {
+		struct icon_location *location = locations->items[i];
+		struct icon_theme_subdir *subdir =
+			theme->subdirs->items[location->subdir];
+		unsigned error = (size > subdir->max_size ? size - subdir->max_size : 0)
+			+ (size < subdir->min_size ? subdir->min_size - size : 0);
+		if (error < smallest_error || (error == smallest_error &&
+					location_precedes(location, best))) {
+			best = location;
+			smallest_error = error;
 		}
 	}
 
-	if (!icon && theme->inherits) {
-		icon = find_icon_with_theme(basedirs, themes, name, size,
-				theme->inherits, min_size, max_size);
+	if (!best) {
+		return theme->inherits ? find_icon_with_theme(basedirs, themes, name,
+				size, theme->inherits, min_size, max_size) : NULL;
 	}
 
+	struct icon_theme_subdir *subdir = theme->subdirs->items[best->subdir];
+	char *basedir = basedirs->items[best->basedir];
+	const char *extension = extensions[best->extension];
+	size_t path_len = snprintf(NULL, 0, "%s/%s/%s/%s.%s", basedir, theme->dir,
+			subdir->name, name, extension) + 1;
+	char *icon = malloc(path_len);
+	if (!icon) {
+		return NULL;
+	}
+	snprintf(icon, path_len, "%s/%s/%s/%s.%s", basedir, theme->dir,
+			subdir->name, name, extension);
+	*min_size = subdir->min_size;
+	*max_size = subdir->max_size;
 	return icon;
 }
 
@@ -2,6 +2,7 @@
 #include <arpa/inet.h>
 #include <cairo.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "swaybar/bar.h"
@@ -15,6 +16,7 @@
 #include "cairo.h"
 #include "list.h"
 #include "log.h"
+#include "loop.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 
 // TODO menu
@@ -25,9 +27,23 @@ static bool sni_ready(struct swaybar_sni *sni) {
 			sni->icon_name || sni->icon_pixmap);
 }
 
+static void destroy_scaled_icon(struct swaybar_scaled_icon *scaled) {
+	cairo_surface_destroy(scaled->surface);
+	free(scaled);
+}
+
+static void clear_scaled_icons(struct swaybar_sni *sni) {
+	while (sni->scaled_icons->length) {
+		destroy_scaled_icon(sni->scaled_icons->items[0]);
+		list_del(sni->scaled_icons, 0);
+	}
+}
+
 static void set_sni_dirty(struct swaybar_sni *sni) {
 	if (sni_ready(sni)) {
 		sni->min_size = sni->max_size = 0; // invalidate previous icon
+		clear_scaled_icons(sni);
+		sni->tray->serial++;
 		set_bar_dirty(sni->tray->bar);
 	}
 }
@@ -42,7 +58,7 @@ static int read_pixmap(sd_bus_message *msg, struct swaybar_sni *sni,
 
 	if (sd_bus_message_at_end(msg, 0)) {
 		sway_log(SWAY_DEBUG, "%s %s no. of icons = 0", sni->watcher_id, prop);
-		return ret;
+		return sd_bus_message_exit_container(msg);
 	}
 
 	list_t *pixmaps = create_list();
@@ -91,6 +107,12 @@ static int read_pixmap(sd_bus_message *msg, struct swaybar_sni *sni,
 		sd_bus_message_exit_container(msg);
 	}
 
+	ret = sd_bus_message_exit_container(msg);
+	if (ret < 0) {
+		sway_log(SWAY_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
+		goto error;
+	}
+
 	if (pixmaps->length < 1) {
 		sway_log(SWAY_DEBUG, "%s %s no. of icons = 0", sni->watcher_id, prop);
 		goto error;
@@ -107,49 +129,77 @@ error:
 	return ret;
 }
 
-struct get_property_data {
-	struct swaybar_sni *sni;
-	const char *prop;
-	const char *type;
-	void *dest;
+#define SNI_PROPERTY(prop) (1 << (prop))
+
+// Ignored: Category, Id, Title, WindowId, OverlayIconName,
+//          OverlayIconPixmap, AttentionMovieName, ToolTip
+static const struct {
+	const char *name;
+	const char *type; // NULL for pixmaps
+	size_t offset;
+} sni_properties[] = {
+	[SNI_STATUS] = {"Status", "s", offsetof(struct swaybar_sni, status)},
+	[SNI_ICON_NAME] = {"IconName", "s", offsetof(struct swaybar_sni, icon_name)},
+	[SNI_ICON_PIXMAP] = {"IconPixmap", NULL,
+		offsetof(struct swaybar_sni, icon_pixmap)},
+	[SNI_ATTENTION_ICON_NAME] = {"AttentionIconName", "s",
+		offsetof(struct swaybar_sni, attention_icon_name)},
+	[SNI_ATTENTION_ICON_PIXMAP] = {"AttentionIconPixmap", NULL,
+		offsetof(struct swaybar_sni, attention_icon_pixmap)},
+	[SNI_ITEM_IS_MENU] = {"ItemIsMenu", "b",
+		offsetof(struct swaybar_sni, item_is_menu)},
+	[SNI_MENU] = {"Menu", "o", offsetof(struct swaybar_sni, menu)},
+	[SNI_ICON_THEME_PATH] = {"IconThemePath", "s",
+		offsetof(struct swaybar_sni, icon_theme_path)},
 };
 
-static int get_property_callback(sd_bus_message *msg, void *data,
-		sd_bus_error *error) {
-	struct get_property_data *d = data;
-	struct swaybar_sni *sni = d->sni;
-	const char *prop = d->prop;
-	const char *type = d->type;
-	void *dest = d->dest;
+// Change signals tend to come in bursts, e.g. NewIcon for every frame of an
+// animation, so the properties they announce are fetched after a short delay
+#define SNI_REFRESH_DELAY 50 // ms
 
-	int ret;
-	if (sd_bus_message_is_method_error(msg, NULL)) {
-		sway_log(SWAY_ERROR, "%s %s: %s", sni->watcher_id, prop,
-				sd_bus_message_get_error(msg)->message);
-		ret = sd_bus_message_get_errno(msg);
-		goto cleanup;
+static int find_sni_property(const char *name) {
+	for (int i = 0; i < SNI_PROPERTY_COUNT; ++i) {
+		if (strcmp(sni_properties[i].name, name) == 0) {
+			return i;
+		}
 	}
+	return -1;
+}
+
+static bool is_kde_sni(struct swaybar_sni *sni) {
+	return strcmp(sni->interface, "org.kde.StatusNotifierItem") == 0;
+}
+
+/*
+ * Reads the variant holding the value of prop from msg into the sni.
+ */
+static int read_property(sd_bus_message *msg, struct swaybar_sni *sni,
+		enum sni_property property) {
+	const char *prop = sni_properties[property].name;
+	const char *type = sni_properties[property].type;
+	void *dest = (char *)sni + sni_properties[property].offset;
 
-	ret = sd_bus_message_enter_container(msg, 'v', type);
+	int ret = sd_bus_message_enter_container(msg, 'v', type);
 	if (ret < 0) {
 		sway_log(SWAY_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
-		goto cleanup;
+		return ret;
 	}
 
 	if (!type) {
 		ret = read_pixmap(msg, sni, prop, dest);
 		if (ret < 0) {
-			goto cleanup;
+			return ret;
 		}
 	} else {
 		if (*type == 's' || *type == 'o') {
 			free(*(char **)dest);
+			*(char **)dest = NULL;
 		}
 
 		ret = sd_bus_message_read(msg, type, dest);
 		if (ret < 0) {
 			sway_log(SWAY_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
-			goto cleanup;
+			return ret;
 		}
 
 		if (*type == 's' || *type == 'o') {
@@ -162,30 +212,142 @@ static int get_property_callback(sd_bus_message *msg, void *data,
 		}
 	}
 
+	ret = sd_bus_message_exit_container(msg);
+	if (ret < 0) {
+		sway_log(SWAY_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
+	}
+	return ret;
+}
+
+static int get_property_callback(sd_bus_message *msg, void *data,
+		sd_bus_error *error) {
+	struct sni_get_property *call = data;
+	struct swaybar_sni *sni = call->sni;
+	const char *prop = sni_properties[call->property].name;
+	call->slot = sd_bus_slot_unref(call->slot);
+
+	if (sd_bus_message_is_method_error(msg, NULL)) {
+		sway_log(SWAY_ERROR, "%s %s: %s", sni->watcher_id, prop,
+				sd_bus_message_get_error(msg)->message);
+		return sd_bus_message_get_errno(msg);
+	}
+
+	int ret = read_property(msg, sni, call->property);
+	if (ret < 0) {
+		return ret;
+	}
+
 	if (strcmp(prop, "Status") == 0 || (sni->status && (sni->status[0] == 'N' ?
 				prop[0] == 'A' : strncmp(prop, "Icon", 4) == 0))) {
 		set_sni_dirty(sni);
 	}
-cleanup:
-	free(data);
 	return ret;
 }
 
-static void sni_get_property_async(struct swaybar_sni *sni, const char *prop,
-		const char *type, void *dest) {
-	struct get_property_data *data = malloc(sizeof(struct get_property_data));
-	data->sni = sni;
-	data->prop = prop;
-	data->type = type;
-	data->dest = dest;
-	int ret = sd_bus_call_method_async(sni->tray->bus, NULL, sni->service,
-			sni->path, "org.freedesktop.DBus.Properties", "Get",
-			get_property_callback, data, "ss", sni->interface, prop);
+static void sni_get_property_async(struct swaybar_sni *sni,
+		enum sni_property property) {
+	const char *prop = sni_properties[property].name;
+	// A reply which is still pending is superseded by this one
+	struct sni_get_property *call = &sni->get_property[property];
+	call->slot = sd_bus_slot_unref(call->slot);
+	call->sni = sni;
+	call->property = property;
+	int ret = sd_bus_call_method_async(sni->tray->bus, &call->slot,
+			sni->service, sni->path, "org.freedesktop.DBus.Properties", "Get",
+			get_property_callback, call, "ss", sni->interface, prop);
 	if (ret < 0) {
 		sway_log(SWAY_ERROR, "%s %s: %s", sni->watcher_id, prop, strerror(-ret));
 	}
 }
 
+static int get_all_properties_callback(sd_bus_message *msg, void *data,
+		sd_bus_error *error) {
+	struct swaybar_sni *sni = data;
+	sni->get_all_slot = sd_bus_slot_unref(sni->get_all_slot);
+
+	if (sd_bus_message_is_method_error(msg, NULL)) {
+		sway_log(SWAY_ERROR, "%s GetAll: %s", sni->watcher_id,
+				sd_bus_message_get_error(msg)->message);
+		// Fall back to fetching the properties one by one
+		for (int i = 0; i < SNI_PROPERTY_COUNT; ++i) {
+			if (i != SNI_ICON_THEME_PATH || is_kde_sni(sni)) {
+				sni_get_property_async(sni, i);
+			}
+		}
+		return sd_bus_message_get_errno(msg);
+	}
+
+	int ret = sd_bus_message_enter_container(msg, 'a', "{sv}");
+	if (ret < 0) {
+		sway_log(SWAY_ERROR, "%s GetAll: %s", sni->watcher_id, strerror(-ret));
+		return ret;
+	}
+
+	while ((ret = sd_bus_message_enter_container(msg, 'e', "sv")) > 0) {
+		const char *prop;
+		ret = sd_bus_message_read(msg, "s", &prop);
+		if (ret < 0) {
+			sway_log(SWAY_ERROR, "%s GetAll: %s", sni->watcher_id, strerror(-ret));
+			break;
+		}
+
+		int property = find_sni_property(prop);
+		if (property == -1) {
+			ret = sd_bus_message_skip(msg, "v");
+		} else {
+			ret = read_property(msg, sni, property);
+		}
+		if (ret < 0) {
+			break;
+		}
+
+		ret = sd_bus_message_exit_container(msg);
+		if (ret < 0) {
+			break;
+		}
+	}
+
+	// Keep whatever was read before an error
+	set_sni_dirty(sni);
+	return ret;
+}
+
+static void sni_get_all_properties_async(struct swaybar_sni *sni) {
+	// A reply which is still pending is superseded by this one
+	sni->get_all_slot = sd_bus_slot_unref(sni->get_all_slot);
+	int ret = sd_bus_call_method_async(sni->tray->bus, &sni->get_all_slot,
+			sni->service, sni->path, "org.freedesktop.DBus.Properties", "GetAll",
+			get_all_properties_callback, sni, "s", sni->interface);
+	if (ret < 0) {
+		sway_log(SWAY_ERROR, "%s GetAll: %s", sni->watcher_id, strerror(-ret));
+	}
+}
+
+static void handle_refresh_timer(void *data) {
+	struct swaybar_sni *sni = data;
+	uint32_t properties = sni->pending_properties;
+	sni->refresh_timer = NULL;
+	sni->pending_properties = 0;
+
+	if (properties & (properties - 1)) {
+		sni_get_all_properties_async(sni);
+		return;
+	}
+	for (int i = 0; i < SNI_PROPERTY_COUNT; ++i) {
+		if (properties & SNI_PROPERTY(i)) {
+			sni_get_property_async(sni, i);
+		}
+	}
+}
+
+static void sni_refresh_properties(struct swaybar_sni *sni, uint32_t properties) {
+	sni->pending_properties |= properties;
+	if (!sni->refresh_timer) {
+		sni->refresh_timer = loop_add_timer(sni->tray->bar->eventloop,
+				SNI_REFRESH_DELAY, handle_refresh_timer, sni);
+	}
+}
+
 /*
  * There is a quirk in sd-bus that in some systems, it is unable to get the
  * well-known names on the bus, so it cannot identify if an incoming signal,
@@ -215,19 +377,20 @@ static int sni_check_msg_sender(struct swaybar_sni *sni, sd_bus_message *msg,
 
 static int handle_new_icon(sd_bus_message *msg, void *data, sd_bus_error *error) {
 	struct swaybar_sni *sni = data;
-	sni_get_property_async(sni, "IconName", "s", &sni->icon_name);
-	sni_get_property_async(sni, "IconPixmap", NULL, &sni->icon_pixmap);
-	if (!strcmp(sni->interface, "org.kde.StatusNotifierItem")) {
-		sni_get_property_async(sni, "IconThemePath", "s", &sni->icon_theme_path);
+	uint32_t properties =
+		SNI_PROPERTY(SNI_ICON_NAME) | SNI_PROPERTY(SNI_ICON_PIXMAP);
+	if (is_kde_sni(sni)) {
+		properties |= SNI_PROPERTY(SNI_ICON_THEME_PATH);
 	}
+	sni_refresh_properties(sni, properties);
 	return sni_check_msg_sender(sni, msg, "icon");
 }
 
 static int handle_new_attention_icon(sd_bus_message *msg, void *data,
 		sd_bus_error *error) {
 	struct swaybar_sni *sni = data;
-	sni_get_property_async(sni, "AttentionIconName", "s", &sni->attention_icon_name);
-	sni_get_property_async(sni, "AttentionIconPixmap", NULL, &sni->attention_icon_pixmap);
+	sni_refresh_properties(sni, SNI_PROPERTY(SNI_ATTENTION_ICON_NAME) |
+			SNI_PROPERTY(SNI_ATTENTION_ICON_PIXMAP));
 	return sni_check_msg_sender(sni, msg, "attention icon");
 }
 
@@ -247,7 +410,7 @@ static int handle_new_status(sd_bus_message *msg, void *data, sd_bus_error *erro
 			set_sni_dirty(sni);
 		}
 	} else {
-		sni_get_property_async(sni, "Status", "s", &sni->status);
+		sni_refresh_properties(sni, SNI_PROPERTY(SNI_STATUS));
 	}
 
 	return ret;
@@ -269,6 +432,7 @@ struct swaybar_sni *create_sni(char *id, struct swaybar_tray *tray) {
 		return NULL;
 	}
 	sni->tray = tray;
+	sni->scaled_icons = create_list();
 	sni->watcher_id = strdup(id);
 	char *path_ptr = strchr(id, '/');
 	if (!path_ptr) {
@@ -279,18 +443,9 @@ struct swaybar_sni *create_sni(char *id, struct swaybar_tray *tray) {
 		sni->service = strndup(id, path_ptr - id);
 		sni->path = strdup(path_ptr);
 		sni->interface = "org.kde.StatusNotifierItem";
-		sni_get_property_async(sni, "IconThemePath", "s", &sni->icon_theme_path);
 	}
 
-	// Ignored: Category, Id, Title, WindowId, OverlayIconName,
-	//          OverlayIconPixmap, AttentionMovieName, ToolTip
-	sni_get_property_async(sni, "Status", "s", &sni->status);
-	sni_get_property_async(sni, "IconName", "s", &sni->icon_name);
-	sni_get_property_async(sni, "IconPixmap", NULL, &sni->icon_pixmap);
-	sni_get_property_async(sni, "AttentionIconName", "s", &sni->attention_icon_name);
-	sni_get_property_async(sni, "AttentionIconPixmap", NULL, &sni->attention_icon_pixmap);
-	sni_get_property_async(sni, "ItemIsMenu", "b", &sni->item_is_menu);
-	sni_get_property_async(sni, "Menu", "o", &sni->menu);
+	sni_get_all_properties_async(sni);
 
 	sni_match_signal(sni, &sni->new_icon_slot, "NewIcon", handle_new_icon);
 	sni_match_signal(sni, &sni->new_attention_icon_slot, "NewAttentionIcon",
@@ -306,7 +461,16 @@ void destroy_sni(struct swaybar_sni *sni) {
 	}
 
 	cairo_surface_destroy(sni->icon);
+	clear_scaled_icons(sni);
+	list_free(sni->scaled_icons);
 
+	if (sni->refresh_timer) {
+		loop_remove_timer(sni->tray->bar->eventloop, sni->refresh_timer);
+	}
+	sd_bus_slot_unref(sni->get_all_slot);
+	for (int i = 0; i < SNI_PROPERTY_COUNT; ++i) {
+		sd_bus_slot_unref(sni->get_property[i].slot);
+	}
 	sd_bus_slot_unref(sni->new_icon_slot);
 	sd_bus_slot_unref(sni->new_attention_icon_slot);
 	sd_bus_slot_unref(sni->new_status_slot);
@@ -401,11 +565,21 @@ static enum hotspot_event_handling icon_hotspot_callback(
 	return HOTSPOT_PROCESS;
 }
 
-uint32_t render_sni(cairo_t *cairo, struct swaybar_output *output, double *x,
-		struct swaybar_sni *sni) {
-	uint32_t height = output->height * output->scale;
-	int padding = output->bar->config->tray_padding;
-	int ideal_size = height - 2*padding;
+#define SCALED_ICONS_MAX 4
+
+/**
+ * Get the icon scaled for the ideal size, loading and scaling it only if it
+ * isn't cached yet. The cache is cleared whenever the icon or status changes.
+ */
+static struct swaybar_scaled_icon *get_scaled_icon(struct swaybar_sni *sni,
+		struct swaybar_output *output, int ideal_size) {
+	for (int i = 0; i < sni->scaled_icons->length; ++i) {
+		struct swaybar_scaled_icon *scaled = sni->scaled_icons->items[i];
+		if (scaled->ideal_size == ideal_size) {
+			return scaled;
+		}
+	}
+
 	if ((ideal_size < sni->min_size || ideal_size > sni->max_size) && sni_ready(sni)) {
 		bool icon_found = false;
 		char *icon_name = sni->status[0] == 'N' ?
@@ -449,6 +623,12 @@ uint32_t render_sni(cairo_t *cairo, struct swaybar_output *output, double *x,
 		}
 	}
 
+	struct swaybar_scaled_icon *scaled =
+		calloc(1, sizeof(struct swaybar_scaled_icon));
+	if (!scaled) {
+		sway_log(SWAY_ERROR, "Unable to allocate scaled icon");
+		return NULL;
+	}
 	int icon_size;
 	cairo_surface_t *icon;
 	if (sni->icon) {
@@ -475,20 +655,41 @@ uint32_t render_sni(cairo_t *cairo, struct swaybar_output *output, double *x,
 		cairo_stroke(cairo_icon);
 		cairo_destroy(cairo_icon);
 	}
+	scaled->ideal_size = ideal_size;
+	scaled->size = icon_size;
+	scaled->surface = icon;
+
+	if (sni->scaled_icons->length == SCALED_ICONS_MAX) {
+		int last = sni->scaled_icons->length - 1;
+		destroy_scaled_icon(sni->scaled_icons->items[last]);
+		list_del(sni->scaled_icons, last);
+	}
+	list_insert(sni->scaled_icons, 0, scaled);
+	return scaled;
+}
+
+uint32_t render_sni(cairo_t *cairo, struct swaybar_output *output, double *x,
+		struct swaybar_sni *sni) {
+	uint32_t height = output->height * output->scale;
+	int padding = output->bar->config->tray_padding;
+	int ideal_size = height - 2*padding;
+	struct swaybar_scaled_icon *scaled = get_scaled_icon(sni, output, ideal_size);
+	if (!scaled) {
+		return 0;
+	}
 
+	int icon_size = scaled->size;
 	int padded_size = icon_size + 2*padding;
 	*x -= padded_size;
 	int y = floor((height - padded_size) / 2.0);
 
 	cairo_operator_t op = cairo_get_operator(cairo);
 	cairo_set_operator(cairo, CAIRO_OPERATOR_OVER);
-	cairo_set_source_surface(cairo, icon, *x + padding, y + padding);
+	cairo_set_source_surface(cairo, scaled->surface, *x + padding, y + padding);
 	cairo_rectangle(cairo, *x, y, padded_size, padded_size);
 	cairo_fill(cairo);
 	cairo_set_operator(cairo, op);
 
-	cairo_surface_destroy(icon);
-
 	struct swaybar_hotspot *hotspot = calloc(1, sizeof(struct swaybar_hotspot));
 	hotspot->x = *x;
 	hotspot->y = 0;